@@ -3,29 +3,339 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include "allocator.h"
 
 #define MIN_PAYLOAD_SIZE 16
 #define DEFAULT_HEAP_SIZE 4096
 #define ALIGNMENT 8
+#define SLAB_RESERVE_SIZE (256UL * 1024 * 1024)
+#define HANDLE_TABLE_INITIAL 256
+#define HEAP_SEED_SIZE 16384
+
+// Call-site prediction tables; both are open-addressed with bounded probing
+#define SITE_TABLE_SIZE 1024
+#define SITE_SAMPLE_TABLE_SIZE 4096
+#define SITE_PROBE_LIMIT 8
+#define SITE_CLOCK_BATCH 64
+#define SITE_AGING_SAMPLES 1024
+
+// False-sharing object table, open-addressed on cache-line number. An
+// object has an entry at its first line and, if it spans more, one at its
+// last line, so a lookup probes only the slots of one line. The hash keeps
+// the top log2(FALSE_SHARING_OBJECTS) bits, so the table size must be a
+// power of two. The probe limit leaves room for a line full of tiny objects
+// plus the edges of its neighbours.
+#define FALSE_SHARING_PROBE_LIMIT 16
+#define FALSE_SHARING_HASH_SHIFT (64 - __builtin_ctzll(FALSE_SHARING_OBJECTS))
+#define TRIM_PAGE_SIZE 4096
+
+// Region blocks start on a cache line after the in-band header
+#define REGION_DATA_OFFSET ((sizeof(region_heap) + 63) & ~(size_t)63)
+#define COMPRESSED_DATA_OFFSET ((sizeof(compressed_heap) + 63) & ~(size_t)63)
+
+// Ring entry states
+#define RING_LIVE 1
+#define RING_FREED 2
+#define RING_PAD 3
+#define SKIP_LINKED 0
+#define SKIP_CLAIMED 1
+#define SKIP_NODE_CHUNK 512
 
 // Global variables
 void* heap_start = NULL;
 void* heap_end = NULL;
 
-typedef struct block_header {
-    size_t payload_size;
-    struct block_header* next;
-    struct block_header* prev;
-    unsigned int is_free;
-    uint32_t magic;  // For debugging and corruption detection
-} block_header;
+// Static seed the first allocations are carved from. Its one free block is
+// set up at compile time, so the heap needs no initialization: the first
+// sbrk happens only when the seed runs out, on the expansion path.
+typedef struct heap_seed_area {
+    block_header first;
+    char bytes[HEAP_SEED_SIZE - sizeof(block_header)];
+} heap_seed_area;
+
+heap_seed_area heap_seed __attribute__((aligned(64))) = {
+    { HEAP_SEED_SIZE - sizeof(block_header), NULL, NULL, 1, 0, MAGIC_FREE }, { 0 }
+};
+
+block_header* free_list = &heap_seed.first;
+
+// Set when the heap runs on a caller's buffer and must never call sbrk
+int heap_fixed = 0;
+
+// Runtime tunables, set from MYALLOC_CONF or my_mallopt
+size_t heap_growth_chunk = DEFAULT_HEAP_SIZE;
+size_t split_threshold = MIN_PAYLOAD_SIZE;
+size_t mmap_threshold = 0;
+size_t trim_threshold = 0;
+uint32_t tcache_count_limit = TCACHE_COUNT_MAX;
+unsigned int lifetime_arena_limit = LIFETIME_ARENA_MAX;
+fit_policy heap_fit_policy = FIT_FIRST;
+free_order heap_free_order = FREE_ORDER_LIFO;
+unsigned int frees_since_sort = 0;
+size_t coalesce_defer = 0;
+size_t deferred_frees = 0;
+size_t heap_merges = 0;
+size_t coalesce_sweeps = 0;
+
+// Quick lists: one per size class, then one per registered extra size
+block_header* quick_bins[SIZE_CLASS_COUNT + QUICK_EXTRA_SIZES];
+uint32_t quick_counts[SIZE_CLASS_COUNT + QUICK_EXTRA_SIZES];
+size_t quick_extra_sizes[QUICK_EXTRA_SIZES];
+unsigned int quick_extra_count = 0;
+uint32_t quick_list_limit = 0;
+size_t quick_held = 0;
+
+// Large free-block index: packed sizes and the blocks they describe
+size_t large_index_min = 0;
+uint64_t* large_sizes = NULL;
+block_header** large_blocks = NULL;
+size_t large_count = 0;
+size_t large_capacity = 0;
+int large_use_avx2 = -1;
+size_t mapped_bytes = 0;
+
+// Concurrent large-block index. Nodes live outside the blocks they describe,
+// in chunks that are never unmapped, so a lock-free reader can always
+// dereference a node it has reached. An unlinked node is reused only after
+// every reader shard has been seen empty.
+typedef struct skip_node {
+    uint64_t size;
+    block_header* block;
+    uint32_t height;
+    uint32_t state;                 // SKIP_LINKED until a thread claims it
+    struct skip_node* spare_next;   // Chain of retired or spare nodes
+    struct skip_node* next[SKIP_MAX_LEVEL];
+} skip_node;
+
+typedef struct skip_reader_shard {
+    uint32_t readers;
+} __attribute__((aligned(64))) skip_reader_shard;
+
+size_t skip_index_min = 0;
+skip_node skip_head;
+skip_node* skip_spare = NULL;       // Nodes ready for reuse
+skip_node* skip_retired = NULL;     // Unlinked nodes readers may still see
+size_t skip_count = 0;
+uint32_t skip_random = 0x9E3779B9u;
+skip_reader_shard skip_readers[SKIP_READER_SHARDS];
+unsigned int skip_reader_next = 0;
+__thread unsigned int my_skip_shard = 0;    // Shard index + 1, 0 until assigned
+pthread_mutex_t skip_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// MYALLOC_CONF names, indexed by mallopt_key
+const char* const mallopt_names[MALLOPT_KEY_COUNT] = {
+    NULL, "growth_chunk", "split_threshold", "mmap_threshold", "trim_threshold",
+    "tcache_count", "arena_max", "policy", "free_order", "coalesce_defer",
+    "quick_count", "quick_size", "large_index", "concurrent_index", "tiny_classes",
+    "line_size", "slab_coloring"
+};
+
+// Named values MYALLOC_CONF accepts besides numbers
+typedef struct mallopt_symbol {
+    int key;
+    const char* name;
+    size_t value;
+} mallopt_symbol;
+
+const mallopt_symbol mallopt_symbols[] = {
+    { MALLOPT_POLICY, "first", FIT_FIRST },
+    { MALLOPT_POLICY, "best", FIT_BEST },
+    { MALLOPT_FREE_ORDER, "lifo", FREE_ORDER_LIFO },
+    { MALLOPT_FREE_ORDER, "address", FREE_ORDER_ADDRESS },
+    { MALLOPT_FREE_ORDER, "sorted", FREE_ORDER_SORTED },
+};
+
+// Serializes every path that touches the shared heap
+pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Thread cache and the key whose destructor flushes it at thread exit
+__thread thread_cache my_tcache;
+__thread int my_tcache_registered = 0;  // Exit hook set up; the limit may still be 0
+pthread_key_t tcache_key;
+pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+// Handle table; entry 0 is reserved so 0 is never a valid handle
+typedef struct handle_entry {
+    block_header* block;    // NULL while the entry is unused
+    uint32_t pins;
+    uint32_t next_free;     // Next unused entry on the free chain
+} handle_entry;
+
+handle_entry* handle_table = NULL;
+uint32_t handle_capacity = 0;
+uint32_t handle_free_head = 0;
+
+// Lifetime arenas: fixed-size region heaps carved from one reserved range,
+// each dedicated to a single lifetime
+char* lifetime_base = NULL;
+unsigned char lifetime_kind[LIFETIME_ARENA_MAX];
+unsigned int lifetime_current[LIFETIME_KIND_COUNT];
+unsigned int lifetime_slots_used = 0;
+pthread_mutex_t lifetime_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Learned behaviour of one allocation site
+typedef struct site_entry {
+    const void* site;           // Return address, NULL while the slot is empty
+    uint32_t samples;
+    uint32_t short_samples;
+    uint32_t predicted_short;
+} site_entry;
+
+// An allocation being followed to measure its lifetime
+typedef struct site_sample {
+    void* ptr;                  // NULL while the slot is empty
+    site_entry* site;
+    uint64_t birth;             // site_clock when allocated
+} site_sample;
+
+int site_prediction_enabled = 0;
+site_entry site_table[SITE_TABLE_SIZE];
+site_sample site_samples[SITE_SAMPLE_TABLE_SIZE];
+uint64_t site_samples_live = 0;
+uint64_t site_clock = 0;        // Allocations seen in prediction mode, in batches
+__thread uint32_t site_sample_countdown = 0;
+__thread uint32_t site_clock_pending = 0;
+
+// An allocation followed by the false-sharing detector. An edge entry, at
+// the object's last line, repeats ptr and size and points at the entry that
+// holds the counts.
+typedef struct fs_object {
+    void* ptr;                  // NULL while the slot is empty
+    size_t size;
+    const void* site;
+    uint32_t writes;
+    uint64_t writers;           // One bit per writing thread, modulo 64
+    struct fs_object* owner;    // Main entry of an edge entry; NULL on the main one
+} fs_object;
+
+int false_sharing_enabled = 0;
+fs_object fs_objects[FALSE_SHARING_OBJECTS];
+uint64_t fs_objects_live = 0;
+uint32_t fs_threads_seen = 0;
+__thread uint32_t false_sharing_countdown = 0;
+__thread uint64_t fs_thread_bit = 0;
+
+// Per-tag counters, one shard per group of threads
+typedef struct tag_shard {
+    int64_t live_bytes[ALLOC_TAG_MAX];
+    uint64_t allocs[ALLOC_TAG_MAX];
+    uint64_t frees[ALLOC_TAG_MAX];
+    uint64_t failures[ALLOC_TAG_MAX];
+} __attribute__((aligned(64))) tag_shard;
+
+// Limits configured for a tag; 0 means no limit
+typedef struct tag_limit {
+    size_t soft;
+    size_t hard;
+    tag_limit_callback callback;
+} tag_limit;
+
+tag_shard tag_shards[TAG_SHARDS];
+tag_limit tag_limits[ALLOC_TAG_MAX];
+unsigned int tag_shard_next = 0;
+__thread tag_shard* my_tag_shard = NULL;
+__thread unsigned int current_alloc_tag = 0;
+
+// Incremental compaction resumes from this offset into the heap
+size_t compact_cursor = 0;
+
+// Heap limits; 0 means no limit. The pressure mark is the heap size past
+// which the next relief runs once the soft limit has been crossed.
+typedef struct shrinker_entry {
+    heap_shrinker shrinker;
+    void* arg;
+} shrinker_entry;
+
+size_t heap_soft_limit = 0;
+size_t heap_hard_limit = 0;
+size_t heap_pressure_mark = 0;
+size_t heap_pressure_events = 0;
+size_t heap_limit_failures = 0;
+shrinker_entry heap_shrinkers[HEAP_SHRINKER_MAX];
+unsigned int heap_shrinker_count = 0;
+pthread_mutex_t pressure_lock = PTHREAD_MUTEX_INITIALIZER;
+char cgroup_pressure_path[256];
+double cgroup_pressure_threshold = 0.0;
+unsigned int cgroup_pressure_countdown = 0;
 
-block_header* free_list = NULL;
+// Per-thread scratch chunk chain: first chunk and the one being bumped
+__thread scratch_chunk* scratch_first = NULL;
+__thread scratch_chunk* scratch_current = NULL;
+pthread_key_t scratch_key;
+pthread_once_t scratch_key_once = PTHREAD_ONCE_INIT;
 
-#define MAGIC_FREE 0xDEADBEEF
-#define MAGIC_ALLOCATED 0xFEEDFACE
+// Repetition helpers used to expand the size-class spec into tables
+#define SC_REP2(M, i) M(i) M((i) + 1)
+#define SC_REP4(M, i) SC_REP2(M, i) SC_REP2(M, (i) + 2)
+#define SC_REP8(M, i) SC_REP4(M, i) SC_REP4(M, (i) + 4)
+#define SC_REP16(M, i) SC_REP8(M, i) SC_REP8(M, (i) + 8)
+#define SC_REP32(M, i) SC_REP16(M, i) SC_REP16(M, (i) + 16)
+#define SC_REP64(M, i) SC_REP32(M, i) SC_REP32(M, (i) + 32)
+#define SC_REP128(M, i) SC_REP64(M, i) SC_REP64(M, (i) + 64)
+
+#define SC_SIZE_ENTRY(i) ((i) < SIZE_CLASS_COUNT ? SIZE_CLASS_SIZE(i) : 0),
+#define SC_LOOKUP_ENTRY(j) SC_CLASS_OF((j) * SIZE_CLASS_SPACING),
+
+// Class sizes and the size-to-class lookup, both fixed at compile time
+const uint32_t size_class_sizes[SIZE_CLASS_CAPACITY] = { SC_REP32(SC_SIZE_ENTRY, 0) };
+const uint8_t size_class_lookup[SIZE_CLASS_LOOKUP_SLOTS] = { SC_REP128(SC_LOOKUP_ENTRY, 0) };
+
+// Slab pages are carved from one reserved range so ownership is a range check
+char* slab_base = NULL;
+char* slab_next = NULL;
+char* slab_limit = NULL;
+slab_header* slab_free_pages = NULL;
+pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Tiny-class slab page, also used by the cache-line classes. Objects follow
+// the bitmap, which has a bit per slot set while the slot is free.
+typedef struct tiny_page {
+    slab_header slab;                   // owner is the page's tiny_class
+    struct tiny_page* next_partial;     // Class's pages with free slots
+    struct tiny_page* prev_partial;
+    uint32_t capacity;
+    uint32_t free_count;
+    uint32_t objects_offset;            // From the start of the page
+    uint32_t first_word;                // No free bit in the words below
+    uint64_t bitmap[];
+} tiny_page;
+
+typedef struct tiny_class {
+    pthread_mutex_t lock;
+    tiny_page* partial;
+    size_t pages;
+    size_t objects;
+    uint32_t next_color;                // Color of the class's next new page
+} tiny_class;
+
+const uint32_t tiny_sizes[TINY_CLASS_COUNT] = { 8, 12, 16, 24 };
+#define TINY_CLASS_INIT { PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0 }
+tiny_class tiny_classes[TINY_CLASS_COUNT] = {
+    TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT
+};
+int tiny_classes_enabled = 0;
+
+// Cache-line classes: 1 to LINE_CLASS_LINES lines of 64 bytes, then the
+// same for 128-byte lines
+#define LINE_CLASS_COUNT (2 * LINE_CLASS_LINES)
+tiny_class line_classes[LINE_CLASS_COUNT] = {
+    TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT,
+    TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT,
+    TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT,
+    TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT, TINY_CLASS_INIT
+};
+size_t cache_line_size = 64;
+int slab_coloring = 1;
 
 // Function declarations
 block_header* find_free_block(size_t required_size);
@@ -35,6 +345,90 @@ void add_to_free_list(block_header* block);
 void remove_from_free_list(block_header* block);
 void* expand_heap(size_t size);
 size_t align_size(size_t size);
+int reserve_slab_range(void);
+unsigned int tiny_class_of(size_t size);
+tiny_page* tiny_page_create(tiny_class* tc, uint32_t object_size, uint32_t align);
+void tiny_unlink_partial(tiny_class* tc, tiny_page* page);
+void* tiny_class_alloc(tiny_class* tc, uint32_t object_size, uint32_t align);
+void* tiny_malloc(size_t size);
+void tiny_free(void* ptr);
+int tiny_class_valid(tiny_class* tc);
+void release_block(block_header* block);
+void* my_malloc_untraced(size_t size);
+void tcache_create_key(void);
+int validate_heap_locked(void);
+void scratch_create_key(void);
+int grow_handle_table(void);
+size_t trim_heap_locked(size_t threshold);
+void* heap_malloc(size_t size);
+void* map_large(size_t size);
+void unmap_large(block_header* block);
+void load_env_config(void);
+void sort_free_list_locked(void);
+void coalesce_sweep_locked(void);
+void coalesce_range(char* start, char* end);
+void release_to_free_list(block_header* block);
+int quick_index(size_t payload_size);
+void quick_drain_locked(void);
+void large_index_update(block_header* block);
+void large_index_remove(block_header* block);
+int large_index_holds(block_header* block);
+void large_index_rebuild(void);
+block_header* large_index_find(size_t required_size);
+size_t large_scan_first(size_t required_size);
+size_t large_scan_best(size_t required_size);
+int skip_before(const skip_node* node, uint64_t size, const block_header* block);
+void skip_find_preds(uint64_t size, const block_header* block, skip_node** preds);
+skip_node* skip_node_get(void);
+int skip_insert(block_header* block);
+void skip_unlink(skip_node* node);
+block_header* skip_claim(size_t size);
+void* skip_malloc(size_t size);
+void skip_drain_locked(void);
+struct region_block* region_block_at(const region_heap* heap, uint64_t offset);
+struct region_block* region_next_block(const region_heap* heap, struct region_block* block);
+struct region_block* region_prev_block(const region_heap* heap, struct region_block* block);
+void region_list_add(region_heap* heap, struct region_block* block);
+void region_list_remove(region_heap* heap, struct region_block* block);
+void region_init_lock(region_heap* heap, int shared);
+int region_format_with_lock(region_heap* heap, size_t size, int shared);
+void region_lock(region_heap* heap);
+int region_validate_locked(region_heap* heap);
+region_heap* shared_heap_map(int fd);
+struct compressed_block* compressed_block_at(const compressed_heap* heap, uint32_t offset);
+struct compressed_block* compressed_next_block(const compressed_heap* heap, struct compressed_block* block);
+struct compressed_block* compressed_prev_block(const compressed_heap* heap, struct compressed_block* block);
+void compressed_list_add(compressed_heap* heap, struct compressed_block* block);
+void compressed_list_remove(compressed_heap* heap, struct compressed_block* block);
+int compressed_contains(const compressed_heap* heap, const void* ptr);
+region_heap* shared_heap_format(int fd, size_t size);
+size_t region_purge_locked(region_heap* heap);
+region_heap* lifetime_arena(unsigned int slot);
+int is_lifetime_address(const void* ptr);
+void lifetime_free(void* ptr);
+site_entry* site_lookup(const void* site, int create);
+tag_shard* tag_shard_for_thread(void);
+int64_t tag_live_bytes(unsigned int tag);
+void tag_account_free(block_header* block);
+void* tag_refuse(unsigned int tag, tag_shard* shard, size_t live, size_t size);
+void* site_malloc(size_t size, const void* site);
+void site_observe_free(void* ptr);
+void* fs_malloc(size_t size, const void* site);
+size_t fs_hash(uintptr_t line);
+fs_object* fs_claim_slot(uintptr_t line);
+fs_object* fs_find(uintptr_t line, const char* addr);
+void fs_forget(void* ptr);
+const fs_object* fs_line_neighbour(const fs_object* object);
+void scratch_destructor(void* chunk);
+void tcache_destructor(void* cache);
+void tcache_register(void);
+block_header* tcache_take_larger(size_t required_size);
+int heap_growth_pressured(size_t grow);
+int cgroup_under_pressure(void);
+size_t heap_purge_locked(void);
+int is_seed_address(const void* ptr);
+int validate_range(char* start, char* end);
+void stats_range(heap_stats* stats, char* start, char* end);
 
 // Align size to ALIGNMENT boundary
 size_t align_size(size_t size) {
@@ -53,45 +447,114 @@ void* init_allocator(size_t initial_size) {
     
     initial_size = align_size(initial_size);
     
-    heap_start = sbrk(0);
-    if (heap_start == (void*)-1) {
+    // sbrk returns the old break, which is where the heap starts. One
+    // header's worth past heap_end stays reserved for expand_heap.
+    void* start = sbrk(initial_size + sizeof(block_header));
+    if (start == (void*)-1) {
         return NULL;
     }
+    heap_start = start;
+    heap_end = (char*)start + initial_size;
+    
+    // The first block joins whatever is left of the seed on the free list
+    block_header* first = (block_header*)heap_start;
+    first->payload_size = initial_size - sizeof(block_header);
+    add_to_free_list(first);
     
-    if (sbrk(initial_size) == (void*)-1) {
-        heap_start = NULL;
+    return heap_start;
+}
+
+// Whether ptr lies in the static seed
+int is_seed_address(const void* ptr) {
+    return (const char*)ptr >= (const char*)&heap_seed &&
+           (const char*)ptr < (const char*)&heap_seed + sizeof(heap_seed);
+}
+
+// Initialize the heap over buffer; it never grows past it
+void* init_allocator_fixed(void* buffer, size_t size) {
+    if (!buffer) return NULL;
+    
+    // Trim the buffer to aligned bounds
+    uintptr_t start = ((uintptr_t)buffer + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1);
+    uintptr_t end = ((uintptr_t)buffer + size) & ~(uintptr_t)(ALIGNMENT - 1);
+    if (end <= start || end - start < sizeof(block_header) + MIN_PAYLOAD_SIZE) {
         return NULL;
     }
     
-    heap_end = sbrk(0);
-    if (heap_end == (void*)-1) {
-        heap_start = NULL;
-        return NULL;
+    pthread_mutex_lock(&heap_lock);
+    if (heap_start != NULL) {
+        pthread_mutex_unlock(&heap_lock);
+        return NULL; // Already running on sbrk or another buffer
     }
     
-    // Initialize the first free block
-    free_list = (block_header*)heap_start;
-    free_list->payload_size = initial_size - sizeof(block_header);
-    free_list->is_free = 1;
-    free_list->next = NULL;
-    free_list->prev = NULL;
-    free_list->magic = MAGIC_FREE;
+    heap_start = (void*)start;
+    heap_end = (void*)end;
+    heap_fixed = 1;
     
+    // Retire the free part of the static seed so the buffer alone sets the
+    // capacity. Retired blocks read as allocated and are never freed; seed
+    // blocks handed out before the switch still come back when freed.
+    quick_drain_locked();
+    block_header* block = free_list;
+    while (block) {
+        block_header* next = block->next;
+        if (is_seed_address(block)) {
+            remove_from_free_list(block);
+            block->is_free = 0;
+            block->magic = MAGIC_ALLOCATED;
+        }
+        block = next;
+    }
+    
+    block_header* first = (block_header*)heap_start;
+    first->payload_size = (end - start) - sizeof(block_header);
+    add_to_free_list(first);
+    pthread_mutex_unlock(&heap_lock);
+    
+    return heap_start;
+}
+
+// Initialize a fixed heap over freshly mapped, prefaulted and mlocked memory,
+// so allocations never take a page fault either
+void* init_allocator_locked(size_t size) {
+    size = (size + TRIM_PAGE_SIZE - 1) & ~(size_t)(TRIM_PAGE_SIZE - 1);
+    void* region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+    if (mlock(region, size) != 0 || init_allocator_fixed(region, size) == NULL) {
+        munmap(region, size);
+        return NULL;
+    }
     return heap_start;
 }
 
 // Find a suitable free block using first-fit strategy
 block_header* find_free_block(size_t required_size) {
+    // Only indexed blocks are large enough for a large request. Ordered
+    // free lists keep their own search so placement stays address-ordered.
+    if (large_index_min && required_size >= large_index_min && heap_free_order == FREE_ORDER_LIFO) {
+        return large_index_find(required_size);
+    }
+    
     block_header* current = free_list;
+    block_header* best = NULL;
     
     while (current != NULL) {
         if (current->is_free && current->payload_size >= required_size) {
-            return current;
+            if (heap_fit_policy == FIT_FIRST || current->payload_size == required_size) {
+                return current;
+            }
+            // Best fit: smallest block that holds the request
+            if (!best || current->payload_size < best->payload_size) {
+                best = current;
+            }
         }
         current = current->next;
     }
     
-    return NULL;
+    return best;
 }
 
 // Split a block if there's enough leftover space
@@ -102,7 +565,7 @@ block_header* split_block(block_header* block, size_t required_size) {
     size_t leftover_size = total_available - required_size;
     
     // Only split if leftover is large enough for a meaningful block
-    if (leftover_size < sizeof(block_header) + MIN_PAYLOAD_SIZE) {
+    if (leftover_size < sizeof(block_header) + split_threshold) {
         return NULL; // Don't split, use the entire block
     }
     
@@ -113,6 +576,7 @@ block_header* split_block(block_header* block, size_t required_size) {
     // Set up the new block
     new_block->payload_size = leftover_size - sizeof(block_header);
     new_block->is_free = 1;
+    new_block->tag = 0;
     new_block->magic = MAGIC_FREE;
     
     // Insert new block into the linked list
@@ -135,9 +599,26 @@ void add_to_free_list(block_header* block) {
     if (!block) return;
     
     block->is_free = 1;
+    block->tag = 0;
     block->magic = MAGIC_FREE;
     
-    // Insert at the beginning of free list for simplicity
+    // Address order: insert after the last block below this one
+    if (heap_free_order == FREE_ORDER_ADDRESS && free_list && free_list < block) {
+        block_header* prev = free_list;
+        while (prev->next && prev->next < block) {
+            prev = prev->next;
+        }
+        block->next = prev->next;
+        block->prev = prev;
+        if (prev->next) {
+            prev->next->prev = block;
+        }
+        prev->next = block;
+        large_index_update(block);
+        return;
+    }
+    
+    // Otherwise insert at the beginning of free list
     block->next = free_list;
     block->prev = NULL;
     
@@ -146,6 +627,75 @@ void add_to_free_list(block_header* block) {
     }
     
     free_list = block;
+    large_index_update(block);
+}
+
+// Sort the free list by address
+void sort_free_list(void) {
+    pthread_mutex_lock(&heap_lock);
+    sort_free_list_locked();
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Bottom-up merge sort on the next links, then rebuild the prev links.
+// Caller holds heap_lock.
+void sort_free_list_locked(void) {
+    block_header* list = free_list;
+    frees_since_sort = 0;
+    
+    for (size_t width = 1; list; width *= 2) {
+        block_header* merged = NULL;
+        block_header** tail = &merged;
+        size_t merges = 0;
+        
+        while (list) {
+            // Split off two runs of up to width blocks each
+            block_header* left = list;
+            block_header* right = left;
+            for (size_t i = 0; i < width && right; i++) {
+                right = right->next;
+            }
+            block_header* rest = right;
+            for (size_t i = 0; i < width && rest; i++) {
+                rest = rest->next;
+            }
+            
+            size_t left_count = 0;
+            size_t right_count = 0;
+            while (left_count < width && left != right) {
+                if (right_count < width && right != rest && right < left) {
+                    *tail = right;
+                    right = right->next;
+                    right_count++;
+                } else {
+                    *tail = left;
+                    left = left->next;
+                    left_count++;
+                }
+                tail = &(*tail)->next;
+            }
+            while (right_count < width && right != rest) {
+                *tail = right;
+                right = right->next;
+                right_count++;
+                tail = &(*tail)->next;
+            }
+            list = rest;
+            merges++;
+        }
+        *tail = NULL;
+        list = merged;
+        if (merges <= 1) {
+            break;
+        }
+    }
+    
+    free_list = list;
+    block_header* prev = NULL;
+    for (block_header* block = free_list; block; block = block->next) {
+        block->prev = prev;
+        prev = block;
+    }
 }
 
 // Remove a block from the free list
@@ -165,23 +715,59 @@ void remove_from_free_list(block_header* block) {
     
     block->next = NULL;
     block->prev = NULL;
+    large_index_remove(block);
 }
 
 // Expand the heap when no suitable free blocks are found
 void* expand_heap(size_t size) {
-    size_t expand_size = (size > DEFAULT_HEAP_SIZE) ? align_size(size) : DEFAULT_HEAP_SIZE;
+    size_t expand_size = (size > heap_growth_chunk) ? align_size(size) : heap_growth_chunk;
     
-    void* old_end = heap_end;
-    if (sbrk(expand_size) == (void*)-1) {
+    if (heap_fixed) {
         return NULL;
     }
     
-    heap_end = sbrk(0);
+    if (heap_hard_limit &&
+        (size_t)((char*)heap_end - (char*)heap_start) + expand_size > heap_hard_limit) {
+        heap_limit_failures++;
+        return NULL;
+    }
+    
+    // The seed ran out: the first expansion creates the sbrk heap
+    if (heap_start == NULL) {
+        return init_allocator(expand_size);
+    }
+    
+    // Someone else, libc malloc for one, may have moved the break since the
+    // last expansion. Their bytes then sit between heap_end and the new
+    // memory, and the header reserved past heap_end describes them as a
+    // block that is never freed.
+    void* old_end = heap_end;
+    char* reserve_end = (char*)heap_end + sizeof(block_header);
+    if ((char*)sbrk(0) != reserve_end) {
+        expand_size += sizeof(block_header) + ALIGNMENT;
+    }
+    char* base = sbrk(expand_size);
+    if (base == (void*)-1) {
+        return NULL;
+    }
     
-    // Create a new block at the old heap end
+    // Create a new block at the old heap end, or past the foreign bytes
     block_header* new_block = (block_header*)old_end;
-    new_block->payload_size = expand_size - sizeof(block_header);
+    if (base != reserve_end) {
+        char* resume = (char*)(((uintptr_t)base + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+        block_header* foreign = (block_header*)old_end;
+        foreign->payload_size = (size_t)(resume - (char*)old_end) - sizeof(block_header);
+        foreign->is_free = 0;
+        foreign->tag = 0;
+        foreign->magic = MAGIC_ALLOCATED;
+        foreign->next = NULL;
+        foreign->prev = NULL;
+        new_block = (block_header*)resume;
+    }
+    heap_end = base + expand_size - sizeof(block_header);
+    new_block->payload_size = (size_t)((char*)heap_end - (char*)new_block) - sizeof(block_header);
     new_block->is_free = 1;
+    new_block->tag = 0;
     new_block->magic = MAGIC_FREE;
     new_block->next = NULL;
     new_block->prev = NULL;
@@ -196,161 +782,3407 @@ void* expand_heap(size_t size) {
         current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
     }
     
-    if (last_block && last_block->is_free) {
+    if (base == reserve_end && last_block && last_block->is_free) {
         // Coalesce with the last block
         last_block->payload_size += expand_size;
+        large_index_update(last_block);
         return last_block;
-    } else {
-        // Add the new block to free list
-        add_to_free_list(new_block);
-        return new_block;
     }
+    
+    // Add the new block to free list
+    add_to_free_list(new_block);
+    
+    // The break moved again between the two sbrk calls
+    if (new_block->payload_size + sizeof(block_header) < size) {
+        return expand_heap(size);
+    }
+    return new_block;
 }
 
-// Main malloc implementation
-void* my_malloc(size_t size) {
-    if (size == 0) {
-        return NULL;
+// Reserve the address range slab pages are carved from. Pages are only
+// backed by memory once touched, so the reservation itself is cheap. A
+// fixed heap makes no mappings, so it gets no slab pages.
+int reserve_slab_range(void) {
+    if (heap_fixed) {
+        return 0;
     }
-    
-    // Initialize heap if not done already
-    if (heap_start == NULL) {
-        if (init_allocator(DEFAULT_HEAP_SIZE) == NULL) {
-            return NULL;
-        }
+    size_t span = SLAB_RESERVE_SIZE + SLAB_PAGE_SIZE;
+    char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return 0;
     }
     
-    // Align the requested size
-    size = align_size(size);
+    // Align the range to SLAB_PAGE_SIZE and give the slack back
+    char* aligned = (char*)(((uintptr_t)raw + SLAB_PAGE_SIZE - 1) & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    size_t tail = (size_t)((raw + span) - (aligned + SLAB_RESERVE_SIZE));
+    if (tail) {
+        munmap(aligned + SLAB_RESERVE_SIZE, tail);
+    }
     
-    // Find a suitable free block
-    block_header* block = find_free_block(size);
+    slab_base = aligned;
+    slab_next = aligned;
+    slab_limit = aligned + SLAB_RESERVE_SIZE;
+    return 1;
+}
+
+// Hand out one SLAB_PAGE_SIZE page, aligned to its size
+void* slab_page_alloc(void) {
+    pthread_mutex_lock(&slab_lock);
+    slab_header* page = slab_free_pages;
     
-    // If no suitable block found, expand the heap
-    if (!block) {
-        block = expand_heap(size + sizeof(block_header));
-        if (!block) {
+    if (page) {
+        slab_free_pages = page->next;
+    } else {
+        if ((slab_base == NULL && !reserve_slab_range()) || slab_next >= slab_limit) {
+            pthread_mutex_unlock(&slab_lock);
             return NULL;
         }
+        page = (slab_header*)slab_next;
+        slab_next += SLAB_PAGE_SIZE;
     }
+    pthread_mutex_unlock(&slab_lock);
     
-    // Remove the block from free list
-    remove_from_free_list(block);
-    
-    // Split the block if there's enough leftover space
-    block_header* leftover = split_block(block, size);
+    page->next = NULL;
+    page->owner = NULL;
+    page->magic = SLAB_PAGE_MAGIC;
+    page->object_size = 0;
+    return page;
+}
+
+// Return a page obtained from slab_page_alloc
+void slab_page_free(void* page) {
+    if (!page) return;
     
-    // If we split the block, add the leftover to free list
-    if (leftover) {
-        add_to_free_list(leftover);
+    slab_header* header = (slab_header*)page;
+    if (!is_slab_page_address(page) || header->magic != SLAB_PAGE_MAGIC) {
+        fprintf(stderr, "Error: Invalid slab page free\n");
+        return;
     }
     
-    // Mark the block as allocated
-    block->is_free = 0;
-    block->magic = MAGIC_ALLOCATED;
-    
-    // Return pointer to the payload
-    return (char*)block + sizeof(block_header);
+    pthread_mutex_lock(&slab_lock);
+    header->magic = 0;
+    header->owner = NULL;
+    header->next = slab_free_pages;
+    slab_free_pages = header;
+    pthread_mutex_unlock(&slab_lock);
 }
 
-// Coalesce adjacent free blocks
-void coalesce_block(block_header* block) {
-    if (!block || !block->is_free) return;
+// Check whether an address lies inside the slab page range
+int is_slab_page_address(const void* ptr) {
+    return slab_base != NULL && (const char*)ptr >= slab_base && (const char*)ptr < slab_next;
+}
+
+// Tiny class serving size bytes, for 0 < size <= TINY_SIZE_MAX
+unsigned int tiny_class_of(size_t size) {
+    return size <= 8 ? 0 : size <= 12 ? 1 : size <= 16 ? 2 : 3;
+}
+
+// Carve a slab page into objects of one tiny class and put it at the head
+// of the class's partial list. The first object starts on an align
+// boundary (a power of two). Caller holds tc->lock.
+tiny_page* tiny_page_create(tiny_class* tc, uint32_t object_size, uint32_t align) {
+    tiny_page* page = (tiny_page*)slab_page_alloc();
+    if (!page) {
+        return NULL;
+    }
+    page->slab.owner = tc;
+    page->slab.object_size = object_size;
     
-    // Find all blocks in memory order to coalesce properly
-    block_header* current = (block_header*)heap_start;
+    // The bitmap shrinks the room for objects, which shrinks the bitmap;
+    // two rounds settle it
+    uint32_t capacity = (uint32_t)((SLAB_PAGE_SIZE - sizeof(tiny_page)) / object_size);
+    uint32_t offset = 0;
+    for (int round = 0; round < 2; round++) {
+        size_t words = (capacity + 63) / 64;
+        offset = (uint32_t)((sizeof(tiny_page) + words * sizeof(uint64_t) + align - 1) & ~(size_t)(align - 1));
+        capacity = (SLAB_PAGE_SIZE - offset) / object_size;
+    }
     
-    while ((char*)current < (char*)heap_end) {
-        if (current == block) {
-            // Try to coalesce with next block
-            block_header* next_in_memory = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
-            
-            if ((char*)next_in_memory < (char*)heap_end && next_in_memory->is_free) {
-                // Remove next block from free list
-                remove_from_free_list(next_in_memory);
-                
-                // Coalesce
-                current->payload_size += sizeof(block_header) + next_in_memory->payload_size;
-            }
-            break;
-        }
-        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    // Spend the whole lines left past the last object on a color
+    uint32_t step = align > SLAB_COLOR_STEP ? align : SLAB_COLOR_STEP;
+    uint32_t colors = (SLAB_PAGE_SIZE - offset - capacity * object_size) / step + 1;
+    if (__atomic_load_n(&slab_coloring, __ATOMIC_RELAXED)) {
+        offset += (tc->next_color++ % colors) * step;
+    }
+    page->capacity = capacity;
+    page->free_count = capacity;
+    page->objects_offset = offset;
+    page->first_word = 0;
+    for (uint32_t word = 0; word < (capacity + 63) / 64; word++) {
+        uint32_t bits = capacity - word * 64;
+        page->bitmap[word] = bits >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
     }
     
-    // Now try to coalesce with previous block
-    current = (block_header*)heap_start;
-    block_header* prev_block = NULL;
+    page->prev_partial = NULL;
+    page->next_partial = tc->partial;
+    if (tc->partial) {
+        tc->partial->prev_partial = page;
+    }
+    tc->partial = page;
+    tc->pages++;
+    return page;
+}
+
+// Take a page off its class's partial list. Caller holds tc->lock.
+void tiny_unlink_partial(tiny_class* tc, tiny_page* page) {
+    if (page->prev_partial) {
+        page->prev_partial->next_partial = page->next_partial;
+    } else {
+        tc->partial = page->next_partial;
+    }
+    if (page->next_partial) {
+        page->next_partial->prev_partial = page->prev_partial;
+    }
+    page->next_partial = NULL;
+    page->prev_partial = NULL;
+}
+
+// Take the lowest free slot of the first page of tc with room
+void* tiny_class_alloc(tiny_class* tc, uint32_t object_size, uint32_t align) {
+    pthread_mutex_lock(&tc->lock);
+    tiny_page* page = tc->partial;
+    if (!page) {
+        page = tiny_page_create(tc, object_size, align);
+        if (!page) {
+            pthread_mutex_unlock(&tc->lock);
+            return NULL;
+        }
+    }
     
-    while ((char*)current < (char*)heap_end && current != block) {
-        prev_block = current;
-        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    uint32_t word = page->first_word;
+    while (page->bitmap[word] == 0) {
+        word++;
     }
+    uint32_t slot = word * 64 + (uint32_t)__builtin_ctzll(page->bitmap[word]);
+    page->bitmap[word] &= page->bitmap[word] - 1;
+    page->first_word = word;
+    if (--page->free_count == 0) {
+        tiny_unlink_partial(tc, page);
+    }
+    tc->objects++;
+    pthread_mutex_unlock(&tc->lock);
     
-    if (prev_block && prev_block->is_free) {
-        block_header* next_expected = (block_header*)((char*)prev_block + sizeof(block_header) + prev_block->payload_size);
-        
-        if (next_expected == block) {
-            // Remove current block from free list
-            remove_from_free_list(block);
-            
-            // Coalesce with previous
-            prev_block->payload_size += sizeof(block_header) + block->payload_size;
-        }
+    return (char*)page + page->objects_offset + (size_t)slot * object_size;
+}
+
+// Tiny object from the class fitting size
+void* tiny_malloc(size_t size) {
+    unsigned int cls = tiny_class_of(size);
+    return tiny_class_alloc(&tiny_classes[cls], tiny_sizes[cls], 8);
+}
+
+// Object covering whole cache lines of the current line size
+void* my_malloc_lines(size_t size) {
+    size_t line = __atomic_load_n(&cache_line_size, __ATOMIC_RELAXED);
+    if (size == 0 || size > LINE_CLASS_LINES * line || heap_fixed) {
+        return NULL;
     }
+    size_t lines = (size + line - 1) / line;
+    unsigned int cls = (line == 128 ? LINE_CLASS_LINES : 0) + (unsigned int)(lines - 1);
+    return tiny_class_alloc(&line_classes[cls], (uint32_t)(lines * line), (uint32_t)line);
 }
 
-// Main free implementation
-void my_free(void* payload_ptr) {
-    if (!payload_ptr) return;
-    
-    // Get the block header
-    block_header* block = (block_header*)((char*)payload_ptr - sizeof(block_header));
+// Free a tiny or cache-line object. A page that empties goes back to the
+// slab pool unless it is the last one its class has room on.
+void tiny_free(void* ptr) {
+    tiny_page* page = (tiny_page*)((uintptr_t)ptr & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
+    uintptr_t owner = (uintptr_t)page->slab.owner;
+    int tiny = owner >= (uintptr_t)tiny_classes && owner < (uintptr_t)(tiny_classes + TINY_CLASS_COUNT);
+    int lines = owner >= (uintptr_t)line_classes && owner < (uintptr_t)(line_classes + LINE_CLASS_COUNT);
+    if (page->slab.magic != SLAB_PAGE_MAGIC || !(tiny || lines)) {
+        fprintf(stderr, "Error: Invalid free - pointer is not from a tiny or line class\n");
+        return;
+    }
+    tiny_class* tc = (tiny_class*)owner;
+    uint32_t object_size = page->slab.object_size;
     
-    // Validate the block
-    if (block->magic != MAGIC_ALLOCATED) {
+    pthread_mutex_lock(&tc->lock);
+    size_t offset = (size_t)((char*)ptr - (char*)page) - page->objects_offset;
+    size_t slot = offset / object_size;
+    uint64_t bit = (uint64_t)1 << (slot % 64);
+    if (offset % object_size != 0 || slot >= page->capacity || (page->bitmap[slot / 64] & bit)) {
+        pthread_mutex_unlock(&tc->lock);
         fprintf(stderr, "Error: Invalid free - corrupted block or double free\n");
         return;
     }
+    page->bitmap[slot / 64] |= bit;
+    if (slot / 64 < page->first_word) {
+        page->first_word = (uint32_t)(slot / 64);
+    }
+    if (page->free_count++ == 0) {
+        page->next_partial = tc->partial;
+        if (tc->partial) {
+            tc->partial->prev_partial = page;
+        }
+        tc->partial = page;
+    }
+    tc->objects--;
+    
+    if (page->free_count == page->capacity && (page->prev_partial || page->next_partial)) {
+        tiny_unlink_partial(tc, page);
+        tc->pages--;
+        slab_page_free(page);
+    }
+    pthread_mutex_unlock(&tc->lock);
+}
+
+// Check that every page of tc with room has as many free bits as free slots
+int tiny_class_valid(tiny_class* tc) {
+    int valid = 1;
+    pthread_mutex_lock(&tc->lock);
+    for (tiny_page* page = tc->partial; page && valid; page = page->next_partial) {
+        uint32_t free_bits = 0;
+        for (uint32_t word = 0; word < (page->capacity + 63) / 64; word++) {
+            free_bits += (uint32_t)__builtin_popcountll(page->bitmap[word]);
+        }
+        valid = free_bits == page->free_count && free_bits > 0;
+    }
+    pthread_mutex_unlock(&tc->lock);
+    return valid;
+}
+
+// Live objects and pages of one tiny class
+void get_tiny_stats(unsigned int cls, tiny_stats* stats) {
+    if (!stats || cls >= TINY_CLASS_COUNT) return;
     
-    // Mark as free
+    tiny_class* tc = &tiny_classes[cls];
+    pthread_mutex_lock(&tc->lock);
+    stats->object_size = tiny_sizes[cls];
+    stats->objects = tc->objects;
+    stats->pages = tc->pages;
+    pthread_mutex_unlock(&tc->lock);
+}
+
+// Footprint per live object of each tiny class, next to what the same
+// request costs as a heap block
+void print_tiny_stats(void) {
+    printf("=== Tiny Classes ===\n");
+    printf("%5s %9s %6s %13s %13s\n", "size", "objects", "pages", "bytes/object", "heap bytes");
+    for (unsigned int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        tiny_stats stats;
+        get_tiny_stats(cls, &stats);
+        size_t heap_bytes = sizeof(block_header) + size_class_sizes[size_to_class(stats.object_size)];
+        if (stats.objects) {
+            printf("%5zu %9zu %6zu %13.2f %13zu\n", stats.object_size, stats.objects, stats.pages,
+                   (double)(stats.pages * SLAB_PAGE_SIZE) / stats.objects, heap_bytes);
+        } else {
+            printf("%5zu %9zu %6zu %13s %13zu\n", stats.object_size, stats.objects, stats.pages, "-", heap_bytes);
+        }
+    }
+    printf("====================\n\n");
+}
+
+// Create the thread-exit key once per process
+void tcache_create_key(void) {
+    pthread_key_create(&tcache_key, tcache_destructor);
+}
+
+// Thread-exit hook registered through tcache_key
+void tcache_destructor(void* cache) {
+    (void)cache;
+    tcache_flush();
+}
+
+// Enable the calling thread's cache and arrange for it to be flushed on exit
+void tcache_register(void) {
+    pthread_once(&tcache_key_once, tcache_create_key);
+    pthread_setspecific(tcache_key, &my_tcache);
+    my_tcache.limit = __atomic_load_n(&tcache_count_limit, __ATOMIC_RELAXED);
+    my_tcache_registered = 1;
+}
+
+// Take a cached block from a larger class before falling back to the shared
+// heap, so recently freed memory is reused first. Caller holds heap_lock.
+block_header* tcache_take_larger(size_t required_size) {
+    for (unsigned int cls = size_to_class(required_size) + 1; cls < SIZE_CLASS_COUNT; cls++) {
+        block_header* block = my_tcache.bins[cls];
+        if (block) {
+            my_tcache.bins[cls] = block->next;
+            my_tcache.counts[cls]--;
+            block->next = NULL;
+            block->prev = NULL;
+            return block;
+        }
+    }
+    return NULL;
+}
+
+// Give a block back to the shared heap, parking it on its quick list if it
+// has one with room. Caller holds heap_lock.
+void release_block(block_header* block) {
+    if (quick_list_limit) {
+        int index = quick_index(block->payload_size);
+        if (index >= 0 && quick_counts[index] < quick_list_limit) {
+            block->is_free = 0;
+            block->magic = MAGIC_QUICK;
+            block->next = quick_bins[index];
+            quick_bins[index] = block;
+            quick_counts[index]++;
+            quick_held++;
+            return;
+        }
+    }
+    release_to_free_list(block);
+}
+
+// Put a block on the free list and merge it. Caller holds heap_lock.
+void release_to_free_list(block_header* block) {
     block->is_free = 1;
     block->magic = MAGIC_FREE;
     
     // Add to free list
     add_to_free_list(block);
     
-    // Coalesce with adjacent free blocks
-    coalesce_block(block);
+    // Coalesce with adjacent free blocks, now or in the next sweep
+    if (coalesce_defer == 0) {
+        coalesce_block(block);
+    } else if (++deferred_frees >= coalesce_defer) {
+        coalesce_sweep_locked();
+    }
+    
+    if (heap_free_order == FREE_ORDER_SORTED && ++frees_since_sort >= FREE_SORT_INTERVAL) {
+        sort_free_list_locked();
+    }
 }
 
-// Validate heap integrity (for debugging)
-int validate_heap() {
-    if (!heap_start) return 1; // Empty heap is valid
-    
-    block_header* current = (block_header*)heap_start;
-    
-    while ((char*)current < (char*)heap_end) {
-        // Check magic number
-        if (current->magic != MAGIC_FREE && current->magic != MAGIC_ALLOCATED) {
-            fprintf(stderr, "Heap corruption detected: invalid magic number\n");
-            return 0;
+// Quick list serving blocks of exactly payload_size bytes, -1 for none
+int quick_index(size_t payload_size) {
+    if (payload_size <= SMALL_SIZE_MAX) {
+        unsigned int cls = size_to_class(payload_size);
+        return size_class_sizes[cls] == payload_size ? (int)cls : -1;
+    }
+    for (unsigned int i = 0; i < quick_extra_count; i++) {
+        if (quick_extra_sizes[i] == payload_size) {
+            return SIZE_CLASS_COUNT + (int)i;
         }
-        
-        // Check if block extends beyond heap
-        if ((char*)current + sizeof(block_header) + current->payload_size > (char*)heap_end) {
-            fprintf(stderr, "Heap corruption detected: block extends beyond heap\n");
-            return 0;
+    }
+    return -1;
+}
+
+// Hand every quick-list block to the free list. Caller holds heap_lock.
+void quick_drain_locked(void) {
+    for (unsigned int index = 0; index < SIZE_CLASS_COUNT + QUICK_EXTRA_SIZES; index++) {
+        block_header* block = quick_bins[index];
+        while (block) {
+            block_header* next = block->next;
+            release_to_free_list(block);
+            block = next;
         }
-        
-        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+        quick_bins[index] = NULL;
+        quick_counts[index] = 0;
     }
-    
-    return 1; // Heap is valid
+    quick_held = 0;
 }
 
-// Debug function to print heap state
-void print_heap_debug() {
-    printf("=== Heap Debug Info ===\n");
+// Whether block is in the large index under the slot in its payload
+int large_index_holds(block_header* block) {
+    uint64_t slot = *(uint64_t*)((char*)block + sizeof(block_header));
+    return slot < large_count && large_blocks[slot] == block;
+}
+
+// Bring a free block's index entry in line with its size: add it, refresh
+// its size or drop it. Caller holds heap_lock.
+void large_index_update(block_header* block) {
+    if (!large_index_min) return;
+    
+    int held = large_index_holds(block);
+    if (block->payload_size < large_index_min) {
+        if (held) {
+            large_index_remove(block);
+        }
+        return;
+    }
+    
+    uint64_t* slot = (uint64_t*)((char*)block + sizeof(block_header));
+    if (held) {
+        large_sizes[*slot] = block->payload_size;
+        return;
+    }
+    
+    // Grow both arrays together by doubling
+    if (large_count == large_capacity) {
+        size_t capacity = large_capacity ? large_capacity * 2 : LARGE_INDEX_INITIAL;
+        size_t bytes = capacity * (sizeof(uint64_t) + sizeof(block_header*));
+        char* arrays = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arrays == MAP_FAILED) {
+            // Unindexed, the block would be invisible to large requests
+            large_index_min = 0;
+            return;
+        }
+        uint64_t* sizes = (uint64_t*)arrays;
+        block_header** blocks = (block_header**)(arrays + capacity * sizeof(uint64_t));
+        if (large_capacity) {
+            memcpy(sizes, large_sizes, large_count * sizeof(uint64_t));
+            memcpy(blocks, large_blocks, large_count * sizeof(block_header*));
+            munmap(large_sizes, large_capacity * (sizeof(uint64_t) + sizeof(block_header*)));
+        }
+        large_sizes = sizes;
+        large_blocks = blocks;
+        large_capacity = capacity;
+    }
+    
+    *slot = large_count;
+    large_sizes[large_count] = block->payload_size;
+    large_blocks[large_count] = block;
+    large_count++;
+}
+
+// Drop a block from the index, moving the last entry into its slot.
+// Caller holds heap_lock.
+void large_index_remove(block_header* block) {
+    if (!large_index_min || !large_index_holds(block)) return;
+    
+    uint64_t slot = *(uint64_t*)((char*)block + sizeof(block_header));
+    large_count--;
+    if (slot != large_count) {
+        block_header* moved = large_blocks[large_count];
+        large_sizes[slot] = large_sizes[large_count];
+        large_blocks[slot] = moved;
+        *(uint64_t*)((char*)moved + sizeof(block_header)) = slot;
+    }
+}
+
+// Index every large block on the free list. Caller holds heap_lock.
+void large_index_rebuild(void) {
+    large_count = 0;
+    for (block_header* block = free_list; block && large_index_min; block = block->next) {
+        large_index_update(block);
+    }
+}
+
+#if defined(__x86_64__)
+// First slot with a size of at least required_size, four sizes per compare
+__attribute__((target("avx2"))) size_t large_scan_first_avx2(size_t required_size) {
+    __m256i need = _mm256_set1_epi64x((long long)required_size - 1);
+    size_t i = 0;
+    for (; i + 4 <= large_count; i += 4) {
+        __m256i sizes = _mm256_loadu_si256((const __m256i*)(large_sizes + i));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(sizes, need)));
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned int)mask);
+        }
+    }
+    for (; i < large_count; i++) {
+        if (large_sizes[i] >= required_size) return i;
+    }
+    return large_count;
+}
+
+// Slot of the smallest size of at least required_size. Each lane keeps its
+// own best candidate; the four are compared at the end.
+__attribute__((target("avx2"))) size_t large_scan_best_avx2(size_t required_size) {
+    __m256i need = _mm256_set1_epi64x((long long)required_size - 1);
+    __m256i best = _mm256_set1_epi64x(INT64_MAX);
+    __m256i best_slot = _mm256_set1_epi64x(-1);
+    __m256i slot = _mm256_setr_epi64x(0, 1, 2, 3);
+    __m256i step = _mm256_set1_epi64x(4);
+    size_t i = 0;
+    for (; i + 4 <= large_count; i += 4) {
+        __m256i sizes = _mm256_loadu_si256((const __m256i*)(large_sizes + i));
+        __m256i better = _mm256_and_si256(_mm256_cmpgt_epi64(sizes, need), _mm256_cmpgt_epi64(best, sizes));
+        best = _mm256_blendv_epi8(best, sizes, better);
+        best_slot = _mm256_blendv_epi8(best_slot, slot, better);
+        slot = _mm256_add_epi64(slot, step);
+    }
+    
+    int64_t lanes[4];
+    int64_t lane_slots[4];
+    _mm256_storeu_si256((__m256i*)lanes, best);
+    _mm256_storeu_si256((__m256i*)lane_slots, best_slot);
+    size_t found = large_count;
+    uint64_t found_size = UINT64_MAX;
+    for (int lane = 0; lane < 4; lane++) {
+        if (lane_slots[lane] >= 0 && (uint64_t)lanes[lane] < found_size) {
+            found_size = (uint64_t)lanes[lane];
+            found = (size_t)lane_slots[lane];
+        }
+    }
+    for (; i < large_count; i++) {
+        if (large_sizes[i] >= required_size && large_sizes[i] < found_size) {
+            found_size = large_sizes[i];
+            found = i;
+        }
+    }
+    return found;
+}
+#endif
+
+// First-fit scan of the packed sizes; large_count when nothing fits
+size_t large_scan_first(size_t required_size) {
+#if defined(__x86_64__)
+    if (large_use_avx2) {
+        return large_scan_first_avx2(required_size);
+    }
+#endif
+    for (size_t i = 0; i < large_count; i++) {
+        if (large_sizes[i] >= required_size) return i;
+    }
+    return large_count;
+}
+
+// Best-fit scan of the packed sizes; large_count when nothing fits
+size_t large_scan_best(size_t required_size) {
+#if defined(__x86_64__)
+    if (large_use_avx2) {
+        return large_scan_best_avx2(required_size);
+    }
+#endif
+    size_t found = large_count;
+    for (size_t i = 0; i < large_count; i++) {
+        if (large_sizes[i] >= required_size && (found == large_count || large_sizes[i] < large_sizes[found])) {
+            found = i;
+        }
+    }
+    return found;
+}
+
+// Large-request search over the index, honouring the fit policy. Caller
+// holds heap_lock.
+block_header* large_index_find(size_t required_size) {
+    if (large_use_avx2 < 0) {
+#if defined(__x86_64__)
+        large_use_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+        large_use_avx2 = 0;
+#endif
+    }
+    
+    size_t slot = heap_fit_policy == FIT_BEST ? large_scan_best(required_size) : large_scan_first(required_size);
+    return slot < large_count ? large_blocks[slot] : NULL;
+}
+
+// Concurrent index order: by size, then by address
+int skip_before(const skip_node* node, uint64_t size, const block_header* block) {
+    return node->size < size || (node->size == size && node->block < block);
+}
+
+// Last node before (size, block) on every level. Caller holds skip_lock.
+void skip_find_preds(uint64_t size, const block_header* block, skip_node** preds) {
+    skip_node* pred = &skip_head;
+    for (int level = SKIP_MAX_LEVEL - 1; level >= 0; level--) {
+        skip_node* next = pred->next[level];
+        while (next && skip_before(next, size, block)) {
+            pred = next;
+            next = pred->next[level];
+        }
+        preds[level] = pred;
+    }
+}
+
+// Node for a new entry. Retired nodes become reusable once every reader
+// shard is seen empty: a reader that could still hold one entered before
+// it was unlinked, and has left by then. Caller holds skip_lock.
+skip_node* skip_node_get(void) {
+    if (!skip_spare && skip_retired) {
+        // Unlinking stores must be visible before the shards are read
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int quiet = 1;
+        for (unsigned int i = 0; i < SKIP_READER_SHARDS && quiet; i++) {
+            quiet = __atomic_load_n(&skip_readers[i].readers, __ATOMIC_SEQ_CST) == 0;
+        }
+        if (quiet) {
+            skip_spare = skip_retired;
+            skip_retired = NULL;
+        }
+    }
+    if (!skip_spare) {
+        skip_node* chunk = mmap(NULL, SKIP_NODE_CHUNK * sizeof(skip_node), PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+            return NULL;
+        }
+        for (unsigned int i = 0; i < SKIP_NODE_CHUNK; i++) {
+            chunk[i].spare_next = skip_spare;
+            skip_spare = &chunk[i];
+        }
+    }
+    skip_node* node = skip_spare;
+    skip_spare = node->spare_next;
+    return node;
+}
+
+// Park a freed block in the concurrent index; 0 if no node could be had
+int skip_insert(block_header* block) {
+    pthread_mutex_lock(&skip_lock);
+    skip_node* node = skip_node_get();
+    if (!node) {
+        pthread_mutex_unlock(&skip_lock);
+        return 0;
+    }
+
+    // Geometric height, one node in four reaching each next level
+    skip_random ^= skip_random << 13;
+    skip_random ^= skip_random >> 17;
+    skip_random ^= skip_random << 5;
+    uint32_t height = 1;
+    for (uint32_t bits = skip_random; height < SKIP_MAX_LEVEL && (bits & 3) == 0; bits >>= 2) {
+        height++;
+    }
+
+    block->is_free = 0;
+    block->magic = MAGIC_PARKED;
+    node->size = block->payload_size;
+    node->block = block;
+    node->height = height;
+    __atomic_store_n(&node->state, SKIP_LINKED, __ATOMIC_RELAXED);
+
+    // Link bottom-up; each release store publishes the node on its level
+    skip_node* preds[SKIP_MAX_LEVEL];
+    skip_find_preds(node->size, block, preds);
+    for (uint32_t level = 0; level < height; level++) {
+        __atomic_store_n(&node->next[level], preds[level]->next[level], __ATOMIC_RELAXED);
+        __atomic_store_n(&preds[level]->next[level], node, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&skip_count, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&skip_lock);
+    return 1;
+}
+
+// Unlink a claimed node top-down. Its own links stay intact so readers
+// standing on it carry on to live nodes. Caller holds skip_lock.
+void skip_unlink(skip_node* node) {
+    skip_node* preds[SKIP_MAX_LEVEL];
+    skip_find_preds(node->size, node->block, preds);
+    for (uint32_t level = node->height; level-- > 0;) {
+        if (preds[level]->next[level] == node) {
+            __atomic_store_n(&preds[level]->next[level], node->next[level], __ATOMIC_RELEASE);
+        }
+    }
+    node->spare_next = skip_retired;
+    skip_retired = node;
+    __atomic_sub_fetch(&skip_count, 1, __ATOMIC_RELAXED);
+}
+
+// Claim the smallest parked block of at least size bytes. The search takes
+// no lock; a compare-and-swap on the node's state decides which thread gets
+// it, and a loser moves on to the following nodes.
+block_header* skip_claim(size_t size) {
+    if (__atomic_load_n(&skip_count, __ATOMIC_RELAXED) == 0) {
+        return NULL;
+    }
+    if (my_skip_shard == 0) {
+        my_skip_shard = __atomic_fetch_add(&skip_reader_next, 1, __ATOMIC_RELAXED) % SKIP_READER_SHARDS + 1;
+    }
+    skip_reader_shard* shard = &skip_readers[my_skip_shard - 1];
+    __atomic_add_fetch(&shard->readers, 1, __ATOMIC_SEQ_CST);
+
+    skip_node* pred = &skip_head;
+    for (int level = SKIP_MAX_LEVEL - 1; level >= 0; level--) {
+        skip_node* next = __atomic_load_n(&pred->next[level], __ATOMIC_ACQUIRE);
+        while (next && next->size < size) {
+            pred = next;
+            next = __atomic_load_n(&pred->next[level], __ATOMIC_ACQUIRE);
+        }
+    }
+
+    skip_node* claimed = NULL;
+    skip_node* node = __atomic_load_n(&pred->next[0], __ATOMIC_ACQUIRE);
+    for (int probe = 0; node && probe < SKIP_CLAIM_PROBES; probe++) {
+        uint32_t expected = SKIP_LINKED;
+        if (__atomic_compare_exchange_n(&node->state, &expected, SKIP_CLAIMED, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            claimed = node;
+            break;
+        }
+        node = __atomic_load_n(&node->next[0], __ATOMIC_ACQUIRE);
+    }
+    __atomic_sub_fetch(&shard->readers, 1, __ATOMIC_SEQ_CST);
+
+    // A claimed node is not retired until unlinked here, so it is still ours
+    if (!claimed) {
+        return NULL;
+    }
+    block_header* block = claimed->block;
+    pthread_mutex_lock(&skip_lock);
+    skip_unlink(claimed);
+    pthread_mutex_unlock(&skip_lock);
+    
+    // split_block links through these, and a parked block's are stale
+    block->next = NULL;
+    block->prev = NULL;
+    return block;
+}
+
+// Allocation from the concurrent index. Splitting a claimed block takes
+// heap_lock only for the split itself; a leftover still large enough is
+// parked again, a smaller one joins the free list.
+void* skip_malloc(size_t size) {
+    size = align_size(size);
+    block_header* block = skip_claim(size);
+    if (!block) {
+        return NULL;
+    }
+    // split_threshold is only stable under heap_lock, so split_block
+    // decides there whether a leftover is worth splitting off
+    size_t parked_min = __atomic_load_n(&skip_index_min, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&heap_lock);
+    block_header* leftover = split_block(block, size);
+    int park = leftover && parked_min && leftover->payload_size >= parked_min;
+    if (park) {
+        // Not free to the heap, or it could merge before it is parked
+        leftover->is_free = 0;
+        leftover->magic = MAGIC_PARKED;
+    } else if (leftover) {
+        release_to_free_list(leftover);
+    }
+    pthread_mutex_unlock(&heap_lock);
+    
+    if (park && !skip_insert(leftover)) {
+        pthread_mutex_lock(&heap_lock);
+        release_to_free_list(leftover);
+        pthread_mutex_unlock(&heap_lock);
+    }
+    block->tag = 0;
+    block->magic = MAGIC_ALLOCATED;
+    return (char*)block + sizeof(block_header);
+}
+
+// Hand every parked block back to the heap and merge them in one sweep.
+// Nodes a thread has claimed but not yet unlinked are left to it. Caller
+// holds heap_lock.
+void skip_drain_locked(void) {
+    block_header* blocks = NULL;
+
+    pthread_mutex_lock(&skip_lock);
+    skip_node* node = skip_head.next[0];
+    while (node) {
+        skip_node* next = node->next[0];
+        uint32_t expected = SKIP_LINKED;
+        if (__atomic_compare_exchange_n(&node->state, &expected, SKIP_CLAIMED, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            node->block->next = blocks;
+            blocks = node->block;
+            skip_unlink(node);
+        }
+        node = next;
+    }
+    pthread_mutex_unlock(&skip_lock);
+
+    if (!blocks) {
+        return;
+    }
+    while (blocks) {
+        block_header* next = blocks->next;
+        add_to_free_list(blocks);
+        blocks = next;
+    }
+    coalesce_sweep_locked();
+}
+
+// Return every block in the calling thread's cache to the shared heap
+void tcache_flush(void) {
+    pthread_mutex_lock(&heap_lock);
+    for (unsigned int cls = 0; cls < SIZE_CLASS_COUNT; cls++) {
+        block_header* block = my_tcache.bins[cls];
+        while (block) {
+            block_header* next = block->next;
+            release_block(block);
+            block = next;
+        }
+        my_tcache.bins[cls] = NULL;
+        my_tcache.counts[cls] = 0;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    
+    // A thread that frees again after exit-time flushing registers anew
+    my_tcache.limit = 0;
+    my_tcache_registered = 0;
+}
+
+// Main malloc implementation; the thread cache hit is inlined from allocator.h
+void* my_malloc(size_t size) {
+    if (current_alloc_tag) {
+        return my_malloc_tagged(size, current_alloc_tag);
+    }
+    if (site_prediction_enabled) {
+        return site_malloc(size, __builtin_return_address(0));
+    }
+    if (__atomic_load_n(&false_sharing_enabled, __ATOMIC_RELAXED)) {
+        return fs_malloc(size, __builtin_return_address(0));
+    }
+    return my_malloc_untraced(size);
+}
+
+// my_malloc below the tagging, prediction and detection layers: tiny slabs
+// when enabled, otherwise the heap
+void* my_malloc_untraced(size_t size) {
+    if (size - 1 < TINY_SIZE_MAX && __atomic_load_n(&tiny_classes_enabled, __ATOMIC_RELAXED)) {
+        return tiny_malloc(size);
+    }
+    return my_malloc_inline(size);
+}
+
+// Allocation taken on a thread cache miss
+void* my_malloc_slow(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    
+    // Large requests get their own mapping
+    size_t threshold = __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+    if (threshold && size >= threshold) {
+        return map_large(size);
+    }
+    
+    // Parked large blocks are claimed without the heap lock
+    size_t parked_min = __atomic_load_n(&skip_index_min, __ATOMIC_RELAXED);
+    if (parked_min && size >= parked_min) {
+        void* ptr = skip_malloc(size);
+        if (ptr) {
+            return ptr;
+        }
+    }
+    return heap_malloc(size);
+}
+
+// Allocation from the shared heap
+void* heap_malloc(size_t size) {
+    // Aligning, or adding a header when growing, would wrap such sizes
+    if (size > SIZE_MAX - sizeof(block_header) - TRIM_PAGE_SIZE) {
+        return NULL;
+    }
+    pthread_mutex_lock(&heap_lock);
+    
+    // Align the requested size, rounding small requests up to their class
+    size = align_size(size);
+    block_header* block = NULL;
+    block_header* leftover;
+    
+    if (size <= SMALL_SIZE_MAX) {
+        size = size_class_sizes[size_to_class(size)];
+    }
+    
+    // An exact-size quick list needs no search, split or merge
+    if (quick_held) {
+        int index = quick_index(size);
+        if (index >= 0 && quick_bins[index]) {
+            block = quick_bins[index];
+            quick_bins[index] = block->next;
+            quick_counts[index]--;
+            quick_held--;
+            block->next = NULL;
+        }
+    }
+    
+    if (!block && size <= SMALL_SIZE_MAX) {
+        block = tcache_take_larger(size);
+        if (block) {
+            // A cached block is still allocated, so its leftover may border
+            // free space and has to be coalesced
+            leftover = split_block(block, size);
+            if (leftover) {
+                release_to_free_list(leftover);
+            }
+        }
+    }
+    
+    if (!block) {
+        // Find a suitable free block
+        block = find_free_block(size);
+        
+        // A miss drains the quick lists and the concurrent index and sweeps
+        // unmerged frees before looking again
+        if (!block && (quick_held || deferred_frees || __atomic_load_n(&skip_count, __ATOMIC_RELAXED))) {
+            quick_drain_locked();
+            skip_drain_locked();
+            if (deferred_frees) {
+                coalesce_sweep_locked();
+            }
+            block = find_free_block(size);
+        }
+        
+        // Growing under pressure relieves it first. Shrinkers free memory
+        // themselves, so the lock is dropped while they run.
+        if (!block && heap_growth_pressured(size + sizeof(block_header))) {
+            pthread_mutex_unlock(&heap_lock);
+            heap_relieve_pressure(size + sizeof(block_header));
+            pthread_mutex_lock(&heap_lock);
+            block = find_free_block(size);
+        }
+        
+        // If no suitable block found, expand the heap
+        if (!block) {
+            block = expand_heap(size + sizeof(block_header));
+            if (!block) {
+                pthread_mutex_unlock(&heap_lock);
+                return NULL;
+            }
+        }
+        
+        // Remove the block from free list
+        remove_from_free_list(block);
+        
+        // Split the block if there's enough leftover space
+        leftover = split_block(block, size);
+        
+        // If we split the block, add the leftover to free list
+        if (leftover) {
+            add_to_free_list(leftover);
+        }
+    }
+    
+    // Mark the block as allocated
+    block->is_free = 0;
+    block->tag = 0;
+    block->magic = MAGIC_ALLOCATED;
+    
+    pthread_mutex_unlock(&heap_lock);
+    
+    // Return pointer to the payload
+    return (char*)block + sizeof(block_header);
+}
+
+// Coalesce adjacent free blocks
+void coalesce_block(block_header* block) {
+    if (!block || !block->is_free) return;
+    
+    // Seed blocks only border other seed blocks
+    char* start = (char*)heap_start;
+    char* end = (char*)heap_end;
+    if (is_seed_address(block)) {
+        start = (char*)&heap_seed;
+        end = start + sizeof(heap_seed);
+    }
+    
+    // Find all blocks in memory order to coalesce properly
+    block_header* current = (block_header*)start;
+    
+    while ((char*)current < end) {
+        if (current == block) {
+            // Try to coalesce with next block
+            block_header* next_in_memory = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+            
+            if ((char*)next_in_memory < end && next_in_memory->is_free) {
+                // Remove next block from free list
+                remove_from_free_list(next_in_memory);
+                
+                // Coalesce
+                current->payload_size += sizeof(block_header) + next_in_memory->payload_size;
+                heap_merges++;
+                large_index_update(current);
+            }
+            break;
+        }
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+    
+    // Now try to coalesce with previous block
+    current = (block_header*)start;
+    block_header* prev_block = NULL;
+    
+    while ((char*)current < end && current != block) {
+        prev_block = current;
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+    
+    if (prev_block && prev_block->is_free) {
+        block_header* next_expected = (block_header*)((char*)prev_block + sizeof(block_header) + prev_block->payload_size);
+        
+        if (next_expected == block) {
+            // Remove current block from free list
+            remove_from_free_list(block);
+            
+            // Coalesce with previous
+            prev_block->payload_size += sizeof(block_header) + block->payload_size;
+            heap_merges++;
+            large_index_update(prev_block);
+        }
+    }
+}
+
+// Merge every run of adjacent free blocks in one address-ordered pass over
+// the seed and the heap. Caller holds heap_lock.
+void coalesce_sweep_locked(void) {
+    coalesce_range((char*)&heap_seed, (char*)&heap_seed + sizeof(heap_seed));
+    if (heap_start) {
+        coalesce_range((char*)heap_start, (char*)heap_end);
+    }
+    deferred_frees = 0;
+    coalesce_sweeps++;
+}
+
+// Sweep behind coalesce_sweep_locked for the blocks between start and end
+void coalesce_range(char* start, char* end) {
+    block_header* current = (block_header*)start;
+    
+    while ((char*)current < end) {
+        block_header* next = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+        if (current->is_free) {
+            while ((char*)next < end && next->is_free) {
+                remove_from_free_list(next);
+                current->payload_size += sizeof(block_header) + next->payload_size;
+                heap_merges++;
+                next = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+            }
+            large_index_update(current);
+        }
+        current = next;
+    }
+}
+
+// Main free implementation; parking in the thread cache is inlined
+void my_free(void* payload_ptr) {
+    if (__atomic_load_n(&site_samples_live, __ATOMIC_RELAXED) && payload_ptr) {
+        site_observe_free(payload_ptr);
+    }
+    if (__atomic_load_n(&fs_objects_live, __ATOMIC_RELAXED) && payload_ptr) {
+        fs_forget(payload_ptr);
+    }
+    // Tiny and line objects have no header; their slab page tells their class
+    if (is_slab_page_address(payload_ptr)) {
+        tiny_free(payload_ptr);
+        return;
+    }
+    my_free_inline(payload_ptr);
+}
+
+// Free into the shared heap, taken when the thread cache cannot take the block
+void my_free_slow(void* payload_ptr) {
+    if (!payload_ptr) return;
+    
+    // Get the block header
+    block_header* block = (block_header*)((char*)payload_ptr - sizeof(block_header));
+    
+    // Lifetime-hinted allocations belong to their arena
+    if (is_lifetime_address(payload_ptr)) {
+        lifetime_free(payload_ptr);
+        return;
+    }
+    
+    // Mapped blocks go straight back to the OS
+    if (block->magic == MAGIC_MAPPED) {
+        if (block->tag) {
+            tag_account_free(block);
+        }
+        unmap_large(block);
+        return;
+    }
+    
+    // Validate the block
+    if (block->magic != MAGIC_ALLOCATED) {
+        fprintf(stderr, "Error: Invalid free - corrupted block or double free\n");
+        return;
+    }
+    
+    // Settle a tagged block's accounting; untagged it can be cached
+    if (block->tag) {
+        tag_account_free(block);
+        block->tag = 0;
+        if (tcache_push(block)) {
+            return;
+        }
+    }
+    
+    // First free on this thread: enable its cache and retry. A cache
+    // disabled by tcache_count:0 stays registered and skips this.
+    if (!my_tcache_registered) {
+        tcache_register();
+        if (tcache_push(block)) {
+            return;
+        }
+    }
+    
+    // Large blocks are parked in the concurrent index without the heap lock
+    size_t parked_min = __atomic_load_n(&skip_index_min, __ATOMIC_RELAXED);
+    if (parked_min && block->payload_size >= parked_min && skip_insert(block)) {
+        return;
+    }
+    
+    pthread_mutex_lock(&heap_lock);
+    release_block(block);
+    
+    // A free tail past the trim threshold goes back to the OS. After
+    // coalescing, block still spans to the end of the free run it joined.
+    if (trim_threshold &&
+        (char*)block + sizeof(block_header) + block->payload_size == (char*)heap_end) {
+        trim_heap_locked(trim_threshold);
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Map a large allocation of its own, returning the payload
+void* map_large(size_t size) {
+    // Rounding up to pages would wrap for sizes this close to SIZE_MAX
+    if (size > SIZE_MAX - sizeof(block_header) - TRIM_PAGE_SIZE) {
+        return NULL;
+    }
+    size_t length = (size + sizeof(block_header) + TRIM_PAGE_SIZE - 1) & ~(size_t)(TRIM_PAGE_SIZE - 1);
+    void* mem = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+    
+    block_header* block = (block_header*)mem;
+    block->payload_size = length - sizeof(block_header);
+    block->next = NULL;
+    block->prev = NULL;
+    block->is_free = 0;
+    block->tag = 0;
+    block->magic = MAGIC_MAPPED;
+    __atomic_fetch_add(&mapped_bytes, length, __ATOMIC_RELAXED);
+    return (char*)block + sizeof(block_header);
+}
+
+// Unmap a block from map_large
+void unmap_large(block_header* block) {
+    size_t length = block->payload_size + sizeof(block_header);
+    block->magic = 0;
+    __atomic_fetch_sub(&mapped_bytes, length, __ATOMIC_RELAXED);
+    munmap(block, length);
+}
+
+// Double the handle table; entries are indices so the table may move
+int grow_handle_table(void) {
+    uint32_t capacity = handle_capacity ? handle_capacity * 2 : HANDLE_TABLE_INITIAL;
+    handle_entry* table = mmap(NULL, capacity * sizeof(handle_entry), PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        return 0;
+    }
+    
+    if (handle_table) {
+        memcpy(table, handle_table, handle_capacity * sizeof(handle_entry));
+        munmap(handle_table, handle_capacity * sizeof(handle_entry));
+    }
+    
+    // Chain the new entries onto the free chain, skipping reserved entry 0
+    for (uint32_t i = capacity - 1; i >= (handle_capacity ? handle_capacity : 1); i--) {
+        table[i].block = NULL;
+        table[i].pins = 0;
+        table[i].next_free = handle_free_head;
+        handle_free_head = i;
+    }
+    
+    handle_table = table;
+    handle_capacity = capacity;
+    return 1;
+}
+
+// Allocate a movable block; the payload is reached through handle_pin
+mem_handle handle_alloc(size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    
+    // The first word of the payload records the owning handle so the
+    // compactor can find the table entry of a block it moves. Handle blocks
+    // must live in the heap itself, never a mapping or an arena.
+    char* payload = (char*)heap_malloc(size + sizeof(uint64_t));
+    if (!payload) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&heap_lock);
+    if (handle_free_head == 0 && !grow_handle_table()) {
+        pthread_mutex_unlock(&heap_lock);
+        my_free(payload);
+        return 0;
+    }
+    mem_handle handle = handle_free_head;
+    handle_free_head = handle_table[handle].next_free;
+    
+    block_header* block = (block_header*)(payload - sizeof(block_header));
+    block->magic = MAGIC_HANDLE;
+    *(uint64_t*)payload = handle;
+    handle_table[handle].block = block;
+    handle_table[handle].pins = 0;
+    pthread_mutex_unlock(&heap_lock);
+    
+    return handle;
+}
+
+// Free a handle and its block
+void handle_free(mem_handle handle) {
+    pthread_mutex_lock(&heap_lock);
+    if (handle == 0 || handle >= handle_capacity || !handle_table[handle].block) {
+        pthread_mutex_unlock(&heap_lock);
+        fprintf(stderr, "Error: Invalid handle free\n");
+        return;
+    }
+    
+    block_header* block = handle_table[handle].block;
+    handle_table[handle].block = NULL;
+    handle_table[handle].next_free = handle_free_head;
+    handle_free_head = handle;
+    
+    // Straight back to the heap: a cached block would pin the hole in place
+    release_to_free_list(block);
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Pin a handle and return its payload; the block stays put until unpinned
+void* handle_pin(mem_handle handle) {
+    pthread_mutex_lock(&heap_lock);
+    if (handle == 0 || handle >= handle_capacity || !handle_table[handle].block) {
+        pthread_mutex_unlock(&heap_lock);
+        return NULL;
+    }
+    
+    handle_table[handle].pins++;
+    char* payload = (char*)handle_table[handle].block + sizeof(block_header) + sizeof(uint64_t);
+    pthread_mutex_unlock(&heap_lock);
+    return payload;
+}
+
+// Drop one pin; a block with no pins may be moved by the compactor
+void handle_unpin(mem_handle handle) {
+    pthread_mutex_lock(&heap_lock);
+    if (handle != 0 && handle < handle_capacity && handle_table[handle].pins > 0) {
+        handle_table[handle].pins--;
+    }
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Slide unpinned handle blocks down into the free block below them, moving
+// at most max_bytes. Free space bubbles up and merges as it goes.
+int compact_heap_step(size_t max_bytes) {
+    pthread_mutex_lock(&heap_lock);
+    if (!heap_start) {
+        pthread_mutex_unlock(&heap_lock);
+        return 1;
+    }
+    if (deferred_frees) {
+        coalesce_sweep_locked();
+    }
+    
+    // Resume at the first block at or after the cursor; blocks may have been
+    // merged or split since the last step
+    block_header* current = (block_header*)heap_start;
+    while ((char*)current < (char*)heap_end && (size_t)((char*)current - (char*)heap_start) < compact_cursor) {
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+    
+    size_t moved = 0;
+    while ((char*)current < (char*)heap_end && moved < max_bytes) {
+        block_header* next = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+        if ((char*)next >= (char*)heap_end) {
+            break;
+        }
+        
+        uint64_t handle = (next->magic == MAGIC_HANDLE) ? *(uint64_t*)((char*)next + sizeof(block_header)) : 0;
+        if (current->magic != MAGIC_FREE || handle == 0 || handle_table[handle].pins > 0) {
+            current = next;
+            continue;
+        }
+        
+        // Move the handle block into the free block's place
+        size_t free_payload = current->payload_size;
+        size_t block_bytes = sizeof(block_header) + next->payload_size;
+        remove_from_free_list(current);
+        memmove(current, next, block_bytes);
+        handle_table[handle].block = current;
+        
+        // The free space now sits above the moved block; merge it upward
+        block_header* hole = (block_header*)((char*)current + block_bytes);
+        hole->payload_size = free_payload;
+        block_header* after = (block_header*)((char*)hole + sizeof(block_header) + free_payload);
+        if ((char*)after < (char*)heap_end && after->magic == MAGIC_FREE) {
+            remove_from_free_list(after);
+            hole->payload_size += sizeof(block_header) + after->payload_size;
+        }
+        add_to_free_list(hole);
+        
+        moved += block_bytes;
+        current = hole;
+    }
+    
+    int done = (char*)current >= (char*)heap_end ||
+               (char*)current + sizeof(block_header) + current->payload_size >= (char*)heap_end;
+    if (done) {
+        compact_cursor = 0;
+        trim_heap_locked(0);
+    } else {
+        compact_cursor = (size_t)((char*)current - (char*)heap_start);
+    }
+    
+    pthread_mutex_unlock(&heap_lock);
+    return done;
+}
+
+// Run compaction steps until a whole pass has completed
+void compact_heap(void) {
+    while (!compact_heap_step(SIZE_MAX)) {
+    }
+}
+
+// Give the free tail of the heap back to the OS
+size_t trim_heap(void) {
+    pthread_mutex_lock(&heap_lock);
+    size_t released = trim_heap_locked(0);
+    pthread_mutex_unlock(&heap_lock);
+    return released;
+}
+
+// Shrink the break over a free last block of at least threshold bytes,
+// keeping whole pages below it. Caller holds heap_lock.
+size_t trim_heap_locked(size_t threshold) {
+    if (!heap_start || heap_fixed) {
+        return 0;
+    }
+    if (deferred_frees) {
+        coalesce_sweep_locked();
+    }
+    
+    block_header* current = (block_header*)heap_start;
+    block_header* last = NULL;
+    while ((char*)current < (char*)heap_end) {
+        last = current;
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+    
+    if (!last || last->magic != MAGIC_FREE || last->payload_size < DEFAULT_HEAP_SIZE + MIN_PAYLOAD_SIZE ||
+        last->payload_size < threshold) {
+        return 0;
+    }
+    
+    // Only shrink if nobody else has moved the break
+    if ((char*)sbrk(0) != (char*)heap_end + sizeof(block_header)) {
+        return 0;
+    }
+    
+    size_t release = (last->payload_size - MIN_PAYLOAD_SIZE) & ~(size_t)(TRIM_PAGE_SIZE - 1);
+    if (release == 0 || sbrk(-(intptr_t)release) == (void*)-1) {
+        return 0;
+    }
+    
+    last->payload_size -= release;
+    heap_end = (char*)heap_end - release;
+    large_index_update(last);
+    return release;
+}
+
+// Header in front of every ring entry; size covers header and payload
+typedef struct ring_entry {
+    uint32_t size;
+    uint32_t state;
+} ring_entry;
+
+// Map the ring buffer; it never comes from the heap
+int ring_init(ring_allocator* ring, size_t capacity) {
+    if (!ring) return 0;
+    
+    capacity = (capacity + SLAB_PAGE_SIZE - 1) & ~(size_t)(SLAB_PAGE_SIZE - 1);
+    if (capacity == 0 || capacity > UINT32_MAX) {
+        return 0;
+    }
+    
+    void* buffer = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        return 0;
+    }
+    
+    ring->buffer = (char*)buffer;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->used = 0;
+    ring->fallbacks = 0;
+    pthread_mutex_init(&ring->lock, NULL);
+    return 1;
+}
+
+// Unmap the ring; entries still live in it become invalid
+void ring_destroy(ring_allocator* ring) {
+    if (!ring || !ring->buffer) return;
+    
+    munmap(ring->buffer, ring->capacity);
+    pthread_mutex_destroy(&ring->lock);
+    ring->buffer = NULL;
+    ring->capacity = 0;
+}
+
+// Allocate at the head, wrapping to the start of the buffer when the entry
+// does not fit before the end
+void* ring_alloc(ring_allocator* ring, size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    
+    // Sizes the ring can never hold skip it before the header is added,
+    // so huge sizes cannot wrap into a small entry
+    size_t need = size <= ring->capacity - sizeof(ring_entry) ? align_size(sizeof(ring_entry) + size) : 0;
+    ring_entry* entry = NULL;
+    
+    pthread_mutex_lock(&ring->lock);
+    if (need && need <= ring->capacity) {
+        if (ring->used == 0) {
+            // Empty ring: restart at offset 0 for the longest contiguous run
+            ring->head = 0;
+            ring->tail = 0;
+        }
+        
+        if (ring->used == 0 || ring->head > ring->tail) {
+            // Free space is [head, capacity) followed by [0, tail)
+            if (need <= ring->capacity - ring->head) {
+                entry = (ring_entry*)(ring->buffer + ring->head);
+            } else if (need <= ring->tail) {
+                // Pad out the end of the buffer and wrap around
+                ring_entry* pad = (ring_entry*)(ring->buffer + ring->head);
+                pad->size = (uint32_t)(ring->capacity - ring->head);
+                pad->state = RING_PAD;
+                ring->used += pad->size;
+                ring->head = 0;
+                entry = (ring_entry*)ring->buffer;
+            }
+        } else if (need <= ring->tail - ring->head) {
+            // Wrapped: free space is [head, tail)
+            entry = (ring_entry*)(ring->buffer + ring->head);
+        }
+    }
+    
+    if (!entry) {
+        // Ring exhausted; serve from the general heap
+        ring->fallbacks++;
+        pthread_mutex_unlock(&ring->lock);
+        return my_malloc(size);
+    }
+    
+    entry->size = (uint32_t)need;
+    entry->state = RING_LIVE;
+    ring->head += need;
+    if (ring->head == ring->capacity) {
+        ring->head = 0;
+    }
+    ring->used += need;
+    pthread_mutex_unlock(&ring->lock);
+    
+    return (char*)entry + sizeof(ring_entry);
+}
+
+// Mark an entry freed and advance the tail over every freed entry
+void ring_free(ring_allocator* ring, void* ptr) {
+    if (!ptr) return;
+    
+    if ((char*)ptr < ring->buffer || (char*)ptr >= ring->buffer + ring->capacity) {
+        // Fallback allocation
+        my_free(ptr);
+        return;
+    }
+    
+    ring_entry* entry = (ring_entry*)((char*)ptr - sizeof(ring_entry));
+    
+    pthread_mutex_lock(&ring->lock);
+    if (entry->state != RING_LIVE) {
+        pthread_mutex_unlock(&ring->lock);
+        fprintf(stderr, "Error: Invalid ring free - corrupted entry or double free\n");
+        return;
+    }
+    entry->state = RING_FREED;
+    
+    while (ring->used > 0) {
+        ring_entry* oldest = (ring_entry*)(ring->buffer + ring->tail);
+        if (oldest->state == RING_LIVE) {
+            break;
+        }
+        ring->used -= oldest->size;
+        ring->tail += oldest->size;
+        if (ring->tail == ring->capacity) {
+            ring->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// Scratch chunk header; the bump region follows it
+struct scratch_chunk {
+    scratch_chunk* next;
+    size_t size;    // Bytes available after the header
+    size_t top;     // Bytes in use
+};
+
+// Create the thread-exit key for scratch chunks once per process
+void scratch_create_key(void) {
+    pthread_key_create(&scratch_key, scratch_destructor);
+}
+
+// Thread-exit hook: every chunk goes back to the heap
+void scratch_destructor(void* chunk) {
+    (void)chunk;
+    scratch_current = NULL;
+    scratch_trim();
+}
+
+// Capture the current top of the calling thread's scratch stack
+scratch_marker scratch_mark(void) {
+    scratch_marker mark;
+    mark.chunk = scratch_current;
+    mark.top = scratch_current ? scratch_current->top : 0;
+    return mark;
+}
+
+// Bump-allocate from the current chunk, moving to the next one when full
+void* scratch_alloc(size_t size) {
+    // Sizes this large would wrap when aligned or given a chunk header
+    if (size == 0 || size > SIZE_MAX - sizeof(scratch_chunk) - ALIGNMENT) {
+        return NULL;
+    }
+    size = align_size(size);
+    
+    scratch_chunk* chunk = scratch_current;
+    if (chunk && chunk->size - chunk->top >= size) {
+        void* ptr = (char*)chunk + sizeof(scratch_chunk) + chunk->top;
+        chunk->top += size;
+        return ptr;
+    }
+    
+    // Reuse the chunk after the current one when it is big enough; otherwise
+    // the rest of the chain is given back and a new chunk takes its place
+    scratch_chunk* next = chunk ? chunk->next : scratch_first;
+    if (!next || next->size < size) {
+        // Unhook the chain before freeing it: the my_malloc below may run
+        // pressure relief, and scratch_trim must not see the freed chunks
+        if (chunk) {
+            chunk->next = NULL;
+        } else {
+            scratch_first = NULL;
+        }
+        while (next) {
+            scratch_chunk* after = next->next;
+            my_free(next);
+            next = after;
+        }
+        
+        size_t chunk_size = size > SCRATCH_CHUNK_SIZE ? size : SCRATCH_CHUNK_SIZE;
+        next = (scratch_chunk*)my_malloc(sizeof(scratch_chunk) + chunk_size);
+        if (!next) {
+            return NULL;
+        }
+        next->next = NULL;
+        next->size = chunk_size;
+        
+        if (chunk) {
+            chunk->next = next;
+        } else {
+            pthread_once(&scratch_key_once, scratch_create_key);
+            pthread_setspecific(scratch_key, next);
+            scratch_first = next;
+        }
+    }
+    
+    next->top = size;
+    scratch_current = next;
+    return (char*)next + sizeof(scratch_chunk);
+}
+
+// Pop everything allocated since the mark
+void scratch_release(scratch_marker mark) {
+    if (mark.chunk) {
+        mark.chunk->top = mark.top;
+        scratch_current = mark.chunk;
+    } else {
+        // Marked before the first allocation: the stack becomes empty
+        scratch_current = NULL;
+    }
+}
+
+// Give chunks beyond the current one back to the heap
+void scratch_trim(void) {
+    scratch_chunk* chunk = scratch_current ? scratch_current->next : scratch_first;
+    while (chunk) {
+        scratch_chunk* next = chunk->next;
+        my_free(chunk);
+        chunk = next;
+    }
+    
+    if (scratch_current) {
+        scratch_current->next = NULL;
+    } else {
+        scratch_first = NULL;
+    }
+}
+
+// Block header inside a region heap. Links are offsets from the region
+// header, and prev_size makes the block before it reachable for O(1)
+// coalescing without walking the region.
+typedef struct region_block {
+    uint64_t payload_size;
+    uint64_t prev_size;   // Payload size of the block before it in memory
+    uint64_t next;        // Free list links, as offsets
+    uint64_t prev;
+    uint32_t is_free;
+    uint32_t magic;
+} region_block;
+
+// Block at an offset, NULL for offset 0
+region_block* region_block_at(const region_heap* heap, uint64_t offset) {
+    return offset ? (region_block*)((char*)heap + offset) : NULL;
+}
+
+// Next block in memory, NULL at the end of the region
+region_block* region_next_block(const region_heap* heap, region_block* block) {
+    char* next = (char*)block + sizeof(region_block) + block->payload_size;
+    if (next + sizeof(region_block) > (char*)heap + heap->size) {
+        return NULL;
+    }
+    return (region_block*)next;
+}
+
+// Previous block in memory, NULL for the first block
+region_block* region_prev_block(const region_heap* heap, region_block* block) {
+    if ((char*)block == (char*)heap + REGION_DATA_OFFSET) {
+        return NULL;
+    }
+    return (region_block*)((char*)block - block->prev_size - sizeof(region_block));
+}
+
+// Push a block onto the region's free list
+void region_list_add(region_heap* heap, region_block* block) {
+    block->is_free = 1;
+    block->magic = MAGIC_FREE;
+    block->prev = 0;
+    block->next = heap->free_head;
+    
+    region_block* head = region_block_at(heap, heap->free_head);
+    if (head) {
+        head->prev = region_offset(heap, block);
+    }
+    heap->free_head = region_offset(heap, block);
+}
+
+// Unlink a block from the region's free list
+void region_list_remove(region_heap* heap, region_block* block) {
+    region_block* prev = region_block_at(heap, block->prev);
+    region_block* next = region_block_at(heap, block->next);
+    
+    if (prev) {
+        prev->next = block->next;
+    } else {
+        heap->free_head = block->next;
+    }
+    if (next) {
+        next->prev = block->prev;
+    }
+    
+    block->next = 0;
+    block->prev = 0;
+}
+
+// Initialize the region lock. A shared lock is process-shared and robust,
+// so a process dying while it holds the lock cannot wedge the others.
+void region_init_lock(region_heap* heap, int shared) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (shared) {
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+    pthread_mutex_init(&heap->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+// Take the region lock, recovering it if its previous owner died
+void region_lock(region_heap* heap) {
+    if (pthread_mutex_lock(&heap->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&heap->lock);
+        // The owner may have died mid-update; say so if it left damage
+        if (!region_validate_locked(heap)) {
+            fprintf(stderr, "Error: Region lock owner died and left the region inconsistent\n");
+        }
+    }
+}
+
+// Lay out an empty region heap over size bytes starting at heap
+int region_format(region_heap* heap, size_t size) {
+    return region_format_with_lock(heap, size, 0);
+}
+
+// region_format with the lock initialized once, process-shared if asked
+int region_format_with_lock(region_heap* heap, size_t size, int shared) {
+    size &= ~(size_t)(ALIGNMENT - 1);
+    if (!heap || size < REGION_DATA_OFFSET + sizeof(region_block) + MIN_PAYLOAD_SIZE) {
+        return 0;
+    }
+    
+    heap->magic = REGION_MAGIC;
+    heap->version = REGION_VERSION;
+    heap->clean = 0;
+    heap->size = size;
+    heap->live_bytes = 0;
+    for (int i = 0; i < REGION_ROOT_COUNT; i++) {
+        heap->roots[i] = 0;
+    }
+    region_init_lock(heap, shared);
+    
+    // One free block spanning the data area
+    region_block* first = (region_block*)((char*)heap + REGION_DATA_OFFSET);
+    first->payload_size = size - REGION_DATA_OFFSET - sizeof(region_block);
+    first->prev_size = 0;
+    heap->free_head = 0;
+    region_list_add(heap, first);
+    
+    return 1;
+}
+
+// First-fit allocation from a region heap
+void* region_alloc(region_heap* heap, size_t size) {
+    // Larger than the whole heap, or large enough to wrap when aligned
+    if (!heap || size == 0 || size > heap->size) {
+        return NULL;
+    }
+    size = align_size(size);
+    
+    region_lock(heap);
+    
+    region_block* block = region_block_at(heap, heap->free_head);
+    while (block && block->payload_size < size) {
+        block = region_block_at(heap, block->next);
+    }
+    if (!block) {
+        pthread_mutex_unlock(&heap->lock);
+        return NULL;
+    }
+    region_list_remove(heap, block);
+    
+    // Split off the tail if it can hold a meaningful block
+    uint64_t leftover = block->payload_size - size;
+    if (leftover >= sizeof(region_block) + MIN_PAYLOAD_SIZE) {
+        region_block* rest = (region_block*)((char*)block + sizeof(region_block) + size);
+        rest->payload_size = leftover - sizeof(region_block);
+        rest->prev_size = size;
+        block->payload_size = size;
+        
+        region_block* after = region_next_block(heap, rest);
+        if (after) {
+            after->prev_size = rest->payload_size;
+        }
+        region_list_add(heap, rest);
+    }
+    
+    block->is_free = 0;
+    block->magic = MAGIC_REGION;
+    heap->live_bytes += block->payload_size;
+    
+    pthread_mutex_unlock(&heap->lock);
+    return (char*)block + sizeof(region_block);
+}
+
+// Free a region allocation, merging it with free neighbours
+void region_free(region_heap* heap, void* ptr) {
+    if (!heap || !ptr) return;
+    
+    if (!region_contains(heap, ptr)) {
+        fprintf(stderr, "Error: Invalid region free - corrupted block or double free\n");
+        return;
+    }
+    
+    // Checked under the lock: another process may be freeing the same block
+    region_block* block = (region_block*)((char*)ptr - sizeof(region_block));
+    region_lock(heap);
+    if (block->magic != MAGIC_REGION) {
+        pthread_mutex_unlock(&heap->lock);
+        fprintf(stderr, "Error: Invalid region free - corrupted block or double free\n");
+        return;
+    }
+    heap->live_bytes -= block->payload_size;
+    
+    region_block* next = region_next_block(heap, block);
+    if (next && next->is_free) {
+        region_list_remove(heap, next);
+        block->payload_size += sizeof(region_block) + next->payload_size;
+        next->magic = 0;
+    }
+    
+    region_block* prev = region_prev_block(heap, block);
+    if (prev && prev->is_free) {
+        region_list_remove(heap, prev);
+        prev->payload_size += sizeof(region_block) + block->payload_size;
+        block->magic = 0;    // Absorbed headers must not pass a later free
+        block = prev;
+    }
+    
+    next = region_next_block(heap, block);
+    if (next) {
+        next->prev_size = block->payload_size;
+    }
+    region_list_add(heap, block);
+    
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// Check whether a payload pointer lies inside a region's data area
+int region_contains(const region_heap* heap, const void* ptr) {
+    return heap && (const char*)ptr >= (const char*)heap + REGION_DATA_OFFSET + sizeof(region_block) &&
+           (const char*)ptr < (const char*)heap + heap->size;
+}
+
+// Walk a region heap checking blocks, boundary tags and the free list
+int region_validate(region_heap* heap) {
+    if (!heap || heap->magic != REGION_MAGIC) return 0;
+    
+    region_lock(heap);
+    int valid = region_validate_locked(heap);
+    pthread_mutex_unlock(&heap->lock);
+    return valid;
+}
+
+// Region walk behind region_validate. Caller holds the region lock.
+int region_validate_locked(region_heap* heap) {
+    size_t free_blocks = 0;
+    uint64_t prev_size = 0;
+    char* end = (char*)heap + heap->size;
+    region_block* block = (region_block*)((char*)heap + REGION_DATA_OFFSET);
+    int valid = 1;
+    
+    while (valid && block) {
+        if (block->magic != MAGIC_FREE && block->magic != MAGIC_REGION) {
+            fprintf(stderr, "Region corruption detected: invalid magic number\n");
+            valid = 0;
+        } else if ((char*)block + sizeof(region_block) + block->payload_size > end) {
+            fprintf(stderr, "Region corruption detected: block extends beyond region\n");
+            valid = 0;
+        } else if (block->prev_size != prev_size) {
+            fprintf(stderr, "Region corruption detected: boundary tag mismatch\n");
+            valid = 0;
+        } else {
+            free_blocks += block->is_free ? 1 : 0;
+            prev_size = block->payload_size;
+            block = region_next_block(heap, block);
+        }
+    }
+    
+    // Every free-list entry must be a free block, and no block may be lost
+    size_t listed = 0;
+    block = region_block_at(heap, heap->free_head);
+    while (valid && block && listed <= free_blocks) {
+        if (!region_contains(heap, (char*)block + sizeof(region_block)) || !block->is_free) {
+            fprintf(stderr, "Region corruption detected: bad free list entry\n");
+            valid = 0;
+        }
+        listed++;
+        block = region_block_at(heap, block->next);
+    }
+    if (valid && listed != free_blocks) {
+        fprintf(stderr, "Region corruption detected: free list does not match blocks\n");
+        valid = 0;
+    }
+    
+    return valid;
+}
+
+// Return the pages inside every free block to the OS
+size_t region_purge(region_heap* heap) {
+    if (!heap) return 0;
+    
+    region_lock(heap);
+    size_t purged = region_purge_locked(heap);
+    pthread_mutex_unlock(&heap->lock);
+    return purged;
+}
+
+// Page purge behind region_purge. Caller holds the region lock.
+size_t region_purge_locked(region_heap* heap) {
+    size_t purged = 0;
+    region_block* block = region_block_at(heap, heap->free_head);
+    
+    while (block) {
+        // Free-list links live in the header, so the payload can be dropped
+        uintptr_t start = (uintptr_t)block + sizeof(region_block);
+        uintptr_t end = start + block->payload_size;
+        start = (start + TRIM_PAGE_SIZE - 1) & ~(uintptr_t)(TRIM_PAGE_SIZE - 1);
+        end &= ~(uintptr_t)(TRIM_PAGE_SIZE - 1);
+        if (end > start && madvise((void*)start, end - start, MADV_DONTNEED) == 0) {
+            purged += end - start;
+        }
+        block = region_block_at(heap, block->next);
+    }
+    return purged;
+}
+
+// Offset of ptr from the region header, 0 for NULL
+uint64_t region_offset(const region_heap* heap, const void* ptr) {
+    return ptr ? (uint64_t)((const char*)ptr - (const char*)heap) : 0;
+}
+
+// Pointer for an offset from the region header, NULL for 0
+void* region_pointer(const region_heap* heap, uint64_t offset) {
+    return offset ? (char*)heap + offset : NULL;
+}
+
+// Record a root so it can be found again after the region is remapped
+void region_set_root(region_heap* heap, unsigned int index, void* ptr) {
+    if (!heap || index >= REGION_ROOT_COUNT) return;
+    heap->roots[index] = region_offset(heap, ptr);
+}
+
+// Look up a root recorded with region_set_root
+void* region_get_root(region_heap* heap, unsigned int index) {
+    if (!heap || index >= REGION_ROOT_COUNT) return NULL;
+    return region_pointer(heap, heap->roots[index]);
+}
+
+// Block header inside a compressed heap. Sizes are in COMPRESSED_UNIT
+// steps, and prev_units makes the block before it reachable for O(1)
+// coalescing.
+typedef struct compressed_block {
+    uint32_t payload_units;
+    uint32_t prev_units;    // Payload units of the block before it in memory
+    uint32_t is_free;
+    uint32_t magic;
+} compressed_block;
+
+// Free-list links, as unit offsets, in the first payload word of a free block
+typedef struct compressed_links {
+    uint32_t next;
+    uint32_t prev;
+} compressed_links;
+
+#define COMPRESSED_LINKS(block) ((compressed_links*)((compressed_block*)(block) + 1))
+
+// Block at a unit offset, NULL for offset 0
+compressed_block* compressed_block_at(const compressed_heap* heap, uint32_t offset) {
+    return offset ? (compressed_block*)((char*)heap + (size_t)offset * COMPRESSED_UNIT) : NULL;
+}
+
+// Next block in memory, NULL at the end of the heap
+compressed_block* compressed_next_block(const compressed_heap* heap, compressed_block* block) {
+    char* next = (char*)(block + 1) + (size_t)block->payload_units * COMPRESSED_UNIT;
+    if (next + sizeof(compressed_block) > (char*)heap + heap->size) {
+        return NULL;
+    }
+    return (compressed_block*)next;
+}
+
+// Previous block in memory, NULL for the first block
+compressed_block* compressed_prev_block(const compressed_heap* heap, compressed_block* block) {
+    if ((char*)block == (char*)heap + COMPRESSED_DATA_OFFSET) {
+        return NULL;
+    }
+    return (compressed_block*)((char*)block - (size_t)block->prev_units * COMPRESSED_UNIT) - 1;
+}
+
+// Push a block onto the compressed heap's free list
+void compressed_list_add(compressed_heap* heap, compressed_block* block) {
+    compressed_links* links = COMPRESSED_LINKS(block);
+    block->is_free = 1;
+    block->magic = MAGIC_FREE;
+    links->prev = 0;
+    links->next = heap->free_head;
+    
+    uint32_t offset = compressed_offset(heap, block);
+    compressed_block* head = compressed_block_at(heap, heap->free_head);
+    if (head) {
+        COMPRESSED_LINKS(head)->prev = offset;
+    }
+    heap->free_head = offset;
+    heap->free_blocks++;
+}
+
+// Unlink a block from the compressed heap's free list
+void compressed_list_remove(compressed_heap* heap, compressed_block* block) {
+    compressed_links* links = COMPRESSED_LINKS(block);
+    compressed_block* prev = compressed_block_at(heap, links->prev);
+    compressed_block* next = compressed_block_at(heap, links->next);
+    
+    if (prev) {
+        COMPRESSED_LINKS(prev)->next = links->next;
+    } else {
+        heap->free_head = links->next;
+    }
+    if (next) {
+        COMPRESSED_LINKS(next)->prev = links->prev;
+    }
+    heap->free_blocks--;
+}
+
+// Reserve size bytes and lay out an empty compressed heap over them
+compressed_heap* compressed_heap_create(size_t size) {
+    size &= ~(size_t)(COMPRESSED_UNIT - 1);
+    if (size < COMPRESSED_DATA_OFFSET + sizeof(compressed_block) + sizeof(compressed_links) ||
+        size > COMPRESSED_HEAP_MAX) {
+        return NULL;
+    }
+    
+    compressed_heap* heap = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap == MAP_FAILED) {
+        return NULL;
+    }
+    heap->size = size;
+    heap->live_bytes = 0;
+    heap->free_head = 0;
+    heap->free_blocks = 0;
+    pthread_mutex_init(&heap->lock, NULL);
+    
+    // One free block spanning the data area
+    compressed_block* first = (compressed_block*)((char*)heap + COMPRESSED_DATA_OFFSET);
+    first->payload_units = (uint32_t)((size - COMPRESSED_DATA_OFFSET - sizeof(compressed_block)) / COMPRESSED_UNIT);
+    first->prev_units = 0;
+    compressed_list_add(heap, first);
+    
+    return heap;
+}
+
+// Release a compressed heap's range; its allocations go with it
+void compressed_heap_destroy(compressed_heap* heap) {
+    if (!heap) return;
+    pthread_mutex_destroy(&heap->lock);
+    munmap(heap, heap->size);
+}
+
+// First-fit allocation from a compressed heap
+void* compressed_alloc(compressed_heap* heap, size_t size) {
+    if (!heap || size == 0 || size > heap->size) {
+        return NULL;
+    }
+    // A block must be able to hold its links once freed
+    if (size < sizeof(compressed_links)) {
+        size = sizeof(compressed_links);
+    }
+    uint32_t units = (uint32_t)(align_size(size) / COMPRESSED_UNIT);
+    
+    pthread_mutex_lock(&heap->lock);
+    
+    compressed_block* block = compressed_block_at(heap, heap->free_head);
+    while (block && block->payload_units < units) {
+        block = compressed_block_at(heap, COMPRESSED_LINKS(block)->next);
+    }
+    if (!block) {
+        pthread_mutex_unlock(&heap->lock);
+        return NULL;
+    }
+    compressed_list_remove(heap, block);
+    
+    // Split off the tail if it can hold a free block
+    uint32_t leftover = block->payload_units - units;
+    if (leftover >= (sizeof(compressed_block) + sizeof(compressed_links)) / COMPRESSED_UNIT) {
+        compressed_block* rest = (compressed_block*)((char*)(block + 1) + (size_t)units * COMPRESSED_UNIT);
+        rest->payload_units = leftover - (uint32_t)(sizeof(compressed_block) / COMPRESSED_UNIT);
+        rest->prev_units = units;
+        block->payload_units = units;
+        
+        compressed_block* after = compressed_next_block(heap, rest);
+        if (after) {
+            after->prev_units = rest->payload_units;
+        }
+        compressed_list_add(heap, rest);
+    }
+    
+    block->is_free = 0;
+    block->magic = MAGIC_COMPRESSED;
+    heap->live_bytes += (uint64_t)block->payload_units * COMPRESSED_UNIT;
+    
+    pthread_mutex_unlock(&heap->lock);
+    return block + 1;
+}
+
+// Free a compressed-heap allocation, merging it with free neighbours
+void compressed_free(compressed_heap* heap, void* ptr) {
+    if (!heap || !ptr) return;
+    
+    compressed_block* block = (compressed_block*)ptr - 1;
+    if (!compressed_contains(heap, ptr) || block->magic != MAGIC_COMPRESSED) {
+        fprintf(stderr, "Error: Invalid compressed heap free - corrupted block or double free\n");
+        return;
+    }
+    
+    pthread_mutex_lock(&heap->lock);
+    heap->live_bytes -= (uint64_t)block->payload_units * COMPRESSED_UNIT;
+    
+    uint32_t header_units = (uint32_t)(sizeof(compressed_block) / COMPRESSED_UNIT);
+    compressed_block* next = compressed_next_block(heap, block);
+    if (next && next->is_free) {
+        compressed_list_remove(heap, next);
+        block->payload_units += header_units + next->payload_units;
+        next->magic = 0;
+    }
+    
+    compressed_block* prev = compressed_prev_block(heap, block);
+    if (prev && prev->is_free) {
+        compressed_list_remove(heap, prev);
+        prev->payload_units += header_units + block->payload_units;
+        block->magic = 0;    // Absorbed headers must not pass a later free
+        block = prev;
+    }
+    
+    next = compressed_next_block(heap, block);
+    if (next) {
+        next->prev_units = block->payload_units;
+    }
+    compressed_list_add(heap, block);
+    
+    pthread_mutex_unlock(&heap->lock);
+}
+
+// Check whether a payload pointer lies inside a compressed heap's data area
+int compressed_contains(const compressed_heap* heap, const void* ptr) {
+    return heap && (const char*)ptr >= (const char*)heap + COMPRESSED_DATA_OFFSET + sizeof(compressed_block) &&
+           (const char*)ptr < (const char*)heap + heap->size;
+}
+
+// Walk a compressed heap checking blocks, boundary tags and the free list
+int compressed_validate(compressed_heap* heap) {
+    if (!heap) return 0;
+    
+    pthread_mutex_lock(&heap->lock);
+    uint32_t free_blocks = 0;
+    uint32_t prev_units = 0;
+    char* end = (char*)heap + heap->size;
+    compressed_block* block = (compressed_block*)((char*)heap + COMPRESSED_DATA_OFFSET);
+    int valid = 1;
+    
+    while (valid && block) {
+        if (block->magic != MAGIC_FREE && block->magic != MAGIC_COMPRESSED) {
+            fprintf(stderr, "Compressed heap corruption detected: invalid magic number\n");
+            valid = 0;
+        } else if ((char*)(block + 1) + (size_t)block->payload_units * COMPRESSED_UNIT > end) {
+            fprintf(stderr, "Compressed heap corruption detected: block extends beyond heap\n");
+            valid = 0;
+        } else if (block->prev_units != prev_units) {
+            fprintf(stderr, "Compressed heap corruption detected: boundary tag mismatch\n");
+            valid = 0;
+        } else {
+            free_blocks += block->is_free ? 1 : 0;
+            prev_units = block->payload_units;
+            block = compressed_next_block(heap, block);
+        }
+    }
+    
+    // Every free-list entry must be a free block, and no block may be lost
+    uint32_t listed = 0;
+    block = compressed_block_at(heap, heap->free_head);
+    while (valid && block && listed <= free_blocks) {
+        if (!compressed_contains(heap, block + 1) || !block->is_free) {
+            fprintf(stderr, "Compressed heap corruption detected: bad free list entry\n");
+            valid = 0;
+        }
+        listed++;
+        block = compressed_block_at(heap, COMPRESSED_LINKS(block)->next);
+    }
+    if (valid && (listed != free_blocks || listed != heap->free_blocks)) {
+        fprintf(stderr, "Compressed heap corruption detected: free list does not match blocks\n");
+        valid = 0;
+    }
+    
+    pthread_mutex_unlock(&heap->lock);
+    return valid;
+}
+
+// Unit offset of ptr from the heap header, 0 for NULL. ptr must be
+// COMPRESSED_UNIT aligned, as every allocation is.
+uint32_t compressed_offset(const compressed_heap* heap, const void* ptr) {
+    return ptr ? (uint32_t)(((const char*)ptr - (const char*)heap) / COMPRESSED_UNIT) : 0;
+}
+
+// Pointer for a unit offset from the heap header, NULL for 0
+void* compressed_pointer(const compressed_heap* heap, uint32_t offset) {
+    return offset ? (char*)heap + (size_t)offset * COMPRESSED_UNIT : NULL;
+}
+
+// Map a persistent heap file, creating and formatting it when new
+region_heap* persistent_heap_open(const char* path, size_t size) {
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    
+    int fresh = (st.st_size == 0);
+    if (fresh) {
+        size = (size + SLAB_PAGE_SIZE - 1) & ~(size_t)(SLAB_PAGE_SIZE - 1);
+        if (size == 0 || ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            return NULL;
+        }
+    } else {
+        size = (size_t)st.st_size;
+    }
+    
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    
+    region_heap* heap = (region_heap*)map;
+    if (fresh) {
+        if (!region_format(heap, size)) {
+            munmap(map, size);
+            return NULL;
+        }
+    } else {
+        if (heap->magic != REGION_MAGIC || heap->version != REGION_VERSION || heap->size > size) {
+            fprintf(stderr, "Error: %s is not a compatible persistent heap\n", path);
+            munmap(map, size);
+            return NULL;
+        }
+        
+        // Whatever state the previous process left the lock in is stale
+        pthread_mutex_init(&heap->lock, NULL);
+        
+        // A heap that was not closed cleanly is only reused if it checks out
+        if (!heap->clean && !region_validate(heap)) {
+            fprintf(stderr, "Error: %s was not closed cleanly and is corrupt\n", path);
+            munmap(map, size);
+            return NULL;
+        }
+    }
+    
+    heap->clean = 0;
+    return heap;
+}
+
+// Flush a persistent heap to its file
+int persistent_heap_sync(region_heap* heap) {
+    if (!heap) return 0;
+    return msync(heap, heap->size, MS_SYNC) == 0;
+}
+
+// Mark the heap clean, flush it and unmap it
+void persistent_heap_close(region_heap* heap) {
+    if (!heap) return;
+    
+    size_t size = heap->size;
+    heap->clean = 1;
+    msync(heap, size, MS_SYNC);
+    munmap(heap, size);
+}
+
+// Map a shared heap segment and check that it holds a region heap
+region_heap* shared_heap_map(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(region_heap)) {
+        return NULL;
+    }
+    
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    
+    region_heap* heap = (region_heap*)map;
+    if (heap->magic != REGION_MAGIC || heap->version != REGION_VERSION ||
+        heap->size > (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    return heap;
+}
+
+// Size a fresh segment, then format it as a region heap with a shared lock
+region_heap* shared_heap_format(int fd, size_t size) {
+    size = (size + SLAB_PAGE_SIZE - 1) & ~(size_t)(SLAB_PAGE_SIZE - 1);
+    if (size == 0 || ftruncate(fd, (off_t)size) != 0) {
+        return NULL;
+    }
+    
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    
+    region_heap* heap = (region_heap*)map;
+    if (!region_format_with_lock(heap, size, 1)) {
+        munmap(map, size);
+        return NULL;
+    }
+    return heap;
+}
+
+// Create a shared heap in a POSIX shm object (name like "/my-heap")
+region_heap* shared_heap_create(const char* name, size_t size) {
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    region_heap* heap = shared_heap_format(fd, size);
+    close(fd);
+    if (!heap) {
+        shm_unlink(name);
+    }
+    return heap;
+}
+
+// Create a shared heap in an anonymous memfd. The descriptor is returned so
+// it can be inherited or passed over a Unix socket; attach with
+// shared_heap_attach_fd and close the descriptor when done.
+int shared_heap_memfd(size_t size) {
+    int fd = memfd_create("allocator-shared-heap", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    region_heap* heap = shared_heap_format(fd, size);
+    if (!heap) {
+        close(fd);
+        return -1;
+    }
+    munmap(heap, heap->size);
+    return fd;
+}
+
+// Map a shared heap created by another process under a POSIX shm name
+region_heap* shared_heap_attach(const char* name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    
+    region_heap* heap = shared_heap_map(fd);
+    close(fd);
+    return heap;
+}
+
+// Map a shared heap from a descriptor returned by shared_heap_memfd
+region_heap* shared_heap_attach_fd(int fd) {
+    return shared_heap_map(fd);
+}
+
+// Unmap a shared heap from this process; the segment lives on
+void shared_heap_detach(region_heap* heap) {
+    if (!heap) return;
+    munmap(heap, heap->size);
+}
+
+// Remove a POSIX shm name; mappings already attached stay valid
+int shared_heap_unlink(const char* name) {
+    return shm_unlink(name) == 0;
+}
+
+// Region heap occupying a lifetime arena slot
+region_heap* lifetime_arena(unsigned int slot) {
+    return (region_heap*)(lifetime_base + (size_t)slot * LIFETIME_ARENA_SIZE);
+}
+
+// Check whether an address lies in a lifetime arena
+int is_lifetime_address(const void* ptr) {
+    return lifetime_base != NULL && (const char*)ptr >= lifetime_base &&
+           (const char*)ptr < lifetime_base + (size_t)lifetime_slots_used * LIFETIME_ARENA_SIZE;
+}
+
+// Allocate from the arenas for a lifetime, falling back to the main heap.
+// The arenas are mapped, so a fixed heap always takes the fallback.
+void* my_malloc_hint(size_t size, lifetime_hint hint) {
+    if (hint <= LIFETIME_DEFAULT || hint >= LIFETIME_KIND_COUNT || size > LIFETIME_ARENA_SIZE / 4 ||
+        heap_fixed) {
+        return my_malloc(size);
+    }
+    if (size == 0) {
+        return NULL;
+    }
+    
+    pthread_mutex_lock(&lifetime_lock);
+    if (lifetime_base == NULL) {
+        void* range = mmap(NULL, LIFETIME_ARENA_SIZE * LIFETIME_ARENA_MAX, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (range == MAP_FAILED) {
+            pthread_mutex_unlock(&lifetime_lock);
+            return my_malloc(size);
+        }
+        lifetime_base = (char*)range;
+    }
+    
+    // The arena that served this lifetime last, then any other of its arenas
+    void* ptr = NULL;
+    unsigned int current = lifetime_current[hint];
+    if (current < lifetime_slots_used && lifetime_kind[current] == hint) {
+        ptr = region_alloc(lifetime_arena(current), size);
+    }
+    for (unsigned int slot = 0; !ptr && slot < lifetime_slots_used; slot++) {
+        if (slot != current && lifetime_kind[slot] == hint) {
+            ptr = region_alloc(lifetime_arena(slot), size);
+            if (ptr) {
+                lifetime_current[hint] = slot;
+            }
+        }
+    }
+    
+    // All full: open a new arena for this lifetime
+    if (!ptr && lifetime_slots_used < lifetime_arena_limit) {
+        unsigned int slot = lifetime_slots_used;
+        if (region_format(lifetime_arena(slot), LIFETIME_ARENA_SIZE)) {
+            lifetime_kind[slot] = (unsigned char)hint;
+            lifetime_current[hint] = slot;
+            lifetime_slots_used++;
+            ptr = region_alloc(lifetime_arena(slot), size);
+        }
+    }
+    pthread_mutex_unlock(&lifetime_lock);
+    
+    return ptr ? ptr : my_malloc(size);
+}
+
+// Free a hinted allocation. A short-lived arena that empties out gives its
+// pages back, which is the point of keeping churn together.
+void lifetime_free(void* ptr) {
+    unsigned int slot = (unsigned int)(((char*)ptr - lifetime_base) / LIFETIME_ARENA_SIZE);
+    region_heap* arena = lifetime_arena(slot);
+    region_free(arena, ptr);
+    
+    if (lifetime_kind[slot] == LIFETIME_SHORT && arena->live_bytes == 0) {
+        region_lock(arena);
+        if (arena->live_bytes == 0) {
+            region_purge_locked(arena);
+        }
+        pthread_mutex_unlock(&arena->lock);
+    }
+}
+
+// Shard the calling thread accounts into, assigned round-robin on first use
+tag_shard* tag_shard_for_thread(void) {
+    if (!my_tag_shard) {
+        unsigned int index = __atomic_fetch_add(&tag_shard_next, 1, __ATOMIC_RELAXED);
+        my_tag_shard = &tag_shards[index % TAG_SHARDS];
+    }
+    return my_tag_shard;
+}
+
+// Live bytes of a tag summed over all shards
+int64_t tag_live_bytes(unsigned int tag) {
+    int64_t live = 0;
+    for (int i = 0; i < TAG_SHARDS; i++) {
+        live += __atomic_load_n(&tag_shards[i].live_bytes[tag], __ATOMIC_RELAXED);
+    }
+    return live;
+}
+
+// Count a refused tagged allocation and tell the tag's callback
+void* tag_refuse(unsigned int tag, tag_shard* shard, size_t live, size_t size) {
+    __atomic_fetch_add(&shard->failures[tag], 1, __ATOMIC_RELAXED);
+    if (tag_limits[tag].callback) {
+        tag_limits[tag].callback(tag, live, size, 1);
+    }
+    return NULL;
+}
+
+// Allocate on behalf of a tag, enforcing its limits
+void* my_malloc_tagged(size_t size, unsigned int tag) {
+    if (tag == 0 || tag >= ALLOC_TAG_MAX) {
+        return my_malloc_inline(size);
+    }
+    
+    tag_shard* shard = tag_shard_for_thread();
+    tag_limit* limit = &tag_limits[tag];
+    int64_t live = 0;
+    if (limit->hard) {
+        // The block is at least size bytes, so this refuses early without
+        // allocating
+        live = tag_live_bytes(tag);
+        if ((size_t)live + size > limit->hard) {
+            return tag_refuse(tag, shard, (size_t)live, size);
+        }
+    }
+    
+    void* ptr = my_malloc_inline(size);
+    if (!ptr) {
+        return NULL;
+    }
+    block_header* block = (block_header*)((char*)ptr - sizeof(block_header));
+    
+    // Limits are checked against the payload the block is accounted at,
+    // which can exceed size when the block was not split
+    if (limit->soft || limit->hard) {
+        size_t charge = block->payload_size;
+        live = tag_live_bytes(tag);
+        if (limit->hard && (size_t)live + charge > limit->hard) {
+            my_free_inline(ptr);
+            return tag_refuse(tag, shard, (size_t)live, charge);
+        }
+        if (limit->soft && (size_t)live < limit->soft && (size_t)live + charge >= limit->soft && limit->callback) {
+            limit->callback(tag, (size_t)live, charge, 0);
+        }
+    }
+    
+    block->tag = (uint16_t)tag;
+    __atomic_fetch_add(&shard->live_bytes[tag], (int64_t)block->payload_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard->allocs[tag], 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+// Take a tagged block out of its tag's live bytes
+void tag_account_free(block_header* block) {
+    tag_shard* shard = tag_shard_for_thread();
+    __atomic_fetch_sub(&shard->live_bytes[block->tag], (int64_t)block->payload_size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard->frees[block->tag], 1, __ATOMIC_RELAXED);
+}
+
+// Make tag the calling thread's current tag; returns the one it replaces
+unsigned int alloc_tag_enter(unsigned int tag) {
+    unsigned int previous = current_alloc_tag;
+    current_alloc_tag = tag < ALLOC_TAG_MAX ? tag : 0;
+    return previous;
+}
+
+// Restore the tag returned by the matching alloc_tag_enter
+void alloc_tag_leave(unsigned int previous) {
+    current_alloc_tag = previous;
+}
+
+// Configure a tag's limits; pass 0 for no limit
+int alloc_tag_set_limit(unsigned int tag, size_t soft_limit, size_t hard_limit, tag_limit_callback callback) {
+    if (tag == 0 || tag >= ALLOC_TAG_MAX) {
+        return 0;
+    }
+    tag_limits[tag].callback = callback;
+    tag_limits[tag].soft = soft_limit;
+    tag_limits[tag].hard = hard_limit;
+    return 1;
+}
+
+// Sum a tag's counters over all shards
+void alloc_tag_stats(unsigned int tag, tag_stats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    if (tag >= ALLOC_TAG_MAX) return;
+    
+    for (int i = 0; i < TAG_SHARDS; i++) {
+        stats->live_bytes += __atomic_load_n(&tag_shards[i].live_bytes[tag], __ATOMIC_RELAXED);
+        stats->allocs += __atomic_load_n(&tag_shards[i].allocs[tag], __ATOMIC_RELAXED);
+        stats->frees += __atomic_load_n(&tag_shards[i].frees[tag], __ATOMIC_RELAXED);
+        stats->failures += __atomic_load_n(&tag_shards[i].failures[tag], __ATOMIC_RELAXED);
+    }
+}
+
+// Print every tag that has seen any traffic
+void print_tag_stats(void) {
+    printf("=== Allocation Tags ===\n");
+    printf("%4s %12s %10s %10s %9s\n", "tag", "live bytes", "allocs", "frees", "refused");
+    for (unsigned int tag = 1; tag < ALLOC_TAG_MAX; tag++) {
+        tag_stats stats;
+        alloc_tag_stats(tag, &stats);
+        if (stats.allocs || stats.failures) {
+            printf("%4u %12lld %10llu %10llu %9llu\n", tag, (long long)stats.live_bytes,
+                   (unsigned long long)stats.allocs, (unsigned long long)stats.frees,
+                   (unsigned long long)stats.failures);
+        }
+    }
+    printf("=======================\n\n");
+}
+
+// Set the heap's soft and hard size limits; 0 means no limit
+void heap_set_limits(size_t soft_limit, size_t hard_limit) {
+    pthread_mutex_lock(&heap_lock);
+    heap_soft_limit = soft_limit;
+    heap_hard_limit = hard_limit;
+    heap_pressure_mark = 0;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Register a callback asked to release memory under pressure
+int heap_add_shrinker(heap_shrinker shrinker, void* arg) {
+    if (!shrinker) return 0;
+    
+    pthread_mutex_lock(&pressure_lock);
+    int added = heap_shrinker_count < HEAP_SHRINKER_MAX;
+    if (added) {
+        heap_shrinkers[heap_shrinker_count].shrinker = shrinker;
+        heap_shrinkers[heap_shrinker_count].arg = arg;
+        heap_shrinker_count++;
+    }
+    pthread_mutex_unlock(&pressure_lock);
+    return added;
+}
+
+// Unregister a shrinker added with the same callback and argument
+int heap_remove_shrinker(heap_shrinker shrinker, void* arg) {
+    int removed = 0;
+    pthread_mutex_lock(&pressure_lock);
+    for (unsigned int i = 0; i < heap_shrinker_count; i++) {
+        if (heap_shrinkers[i].shrinker == shrinker && heap_shrinkers[i].arg == arg) {
+            heap_shrinkers[i] = heap_shrinkers[--heap_shrinker_count];
+            removed = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pressure_lock);
+    return removed;
+}
+
+// Treat the heap as pressured while the cgroup's "some avg10" stall
+// percentage is at least threshold. NULL path means the calling process's
+// cgroup v2 default; a threshold of 0 stops watching.
+int heap_watch_cgroup_pressure(const char* path, double threshold) {
+    if (!path) {
+        path = "/sys/fs/cgroup/memory.pressure";
+    }
+    if (strlen(path) >= sizeof(cgroup_pressure_path)) {
+        return 0;
+    }
+    
+    pthread_mutex_lock(&heap_lock);
+    strcpy(cgroup_pressure_path, path);
+    cgroup_pressure_threshold = threshold;
+    cgroup_pressure_countdown = 0;
+    pthread_mutex_unlock(&heap_lock);
+    return 1;
+}
+
+// Read the watched memory.pressure file. Read with plain syscalls so it
+// never allocates. Caller holds heap_lock.
+int cgroup_under_pressure(void) {
+    char buffer[256];
+    int fd = open(cgroup_pressure_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) {
+        return 0;
+    }
+    buffer[length] = '\0';
+    
+    // First line: "some avg10=1.23 avg60=... avg300=... total=..."
+    const char* field = strstr(buffer, "some avg10=");
+    if (!field) {
+        return 0;
+    }
+    double avg10 = 0.0;
+    if (sscanf(field + strlen("some avg10="), "%lf", &avg10) != 1) {
+        return 0;
+    }
+    return avg10 >= cgroup_pressure_threshold;
+}
+
+// Whether growing the heap by grow bytes has to relieve pressure first. The
+// soft limit fires when crossed and again every eighth of it beyond, so a
+// heap that stays above the limit is not relieved on every expansion.
+// Caller holds heap_lock.
+int heap_growth_pressured(size_t grow) {
+    size_t current = heap_start ? (size_t)((char*)heap_end - (char*)heap_start) : 0;
+    
+    if (heap_soft_limit && current + grow > heap_soft_limit) {
+        if (current <= heap_soft_limit || current + grow > heap_pressure_mark) {
+            heap_pressure_mark = current + grow + heap_soft_limit / 8;
+            return 1;
+        }
+    }
+    
+    if (cgroup_pressure_threshold > 0.0) {
+        if (cgroup_pressure_countdown == 0) {
+            cgroup_pressure_countdown = HEAP_PRESSURE_POLL;
+            if (cgroup_under_pressure()) {
+                return 1;
+            }
+        }
+        cgroup_pressure_countdown--;
+    }
+    return 0;
+}
+
+// Drop the pages inside free blocks; the headers stay. A fixed heap keeps
+// its pages, which may be locked. Caller holds heap_lock.
+size_t heap_purge_locked(void) {
+    size_t purged = 0;
+    block_header* block = heap_fixed ? NULL : free_list;
+    
+    while (block) {
+        // Seed pages are static data and stay put; the first payload word
+        // may hold the block's index slot
+        uintptr_t start = (uintptr_t)block + sizeof(block_header) + sizeof(uint64_t);
+        uintptr_t end = start + block->payload_size;
+        start = (start + TRIM_PAGE_SIZE - 1) & ~(uintptr_t)(TRIM_PAGE_SIZE - 1);
+        end &= ~(uintptr_t)(TRIM_PAGE_SIZE - 1);
+        if (end > start && !is_seed_address(block) &&
+            madvise((void*)start, end - start, MADV_DONTNEED) == 0) {
+            purged += end - start;
+        }
+        block = block->next;
+    }
+    return purged;
+}
+
+// Release memory ahead of growth: the calling thread's caches go back first
+// so that what the shrinkers free can coalesce with them, then free pages
+// of the heap and the lifetime arenas are purged and the heap tail trimmed.
+// Returns the bytes shrinkers reported plus those purged and trimmed.
+size_t heap_relieve_pressure(size_t wanted) {
+    size_t released = 0;
+    
+    pthread_mutex_lock(&heap_lock);
+    heap_pressure_events++;
+    pthread_mutex_unlock(&heap_lock);
+    
+    tcache_flush();
+    scratch_trim();
+    
+    // Shrinkers run unlocked on a snapshot so they may allocate and free
+    shrinker_entry shrinkers[HEAP_SHRINKER_MAX];
+    pthread_mutex_lock(&pressure_lock);
+    unsigned int count = heap_shrinker_count;
+    memcpy(shrinkers, heap_shrinkers, count * sizeof(shrinker_entry));
+    pthread_mutex_unlock(&pressure_lock);
+    for (unsigned int i = 0; i < count; i++) {
+        released += shrinkers[i].shrinker(wanted, shrinkers[i].arg);
+    }
+    
+    pthread_mutex_lock(&lifetime_lock);
+    for (unsigned int slot = 0; slot < lifetime_slots_used; slot++) {
+        released += region_purge(lifetime_arena(slot));
+    }
+    pthread_mutex_unlock(&lifetime_lock);
+    
+    pthread_mutex_lock(&heap_lock);
+    quick_drain_locked();
+    skip_drain_locked();
+    released += trim_heap_locked(0);
+    released += heap_purge_locked();
+    pthread_mutex_unlock(&heap_lock);
+    
+    return released;
+}
+
+// Change a tunable; returns 0 for an unknown key or a value out of range
+int my_mallopt(int key, size_t value) {
+    int applied = 1;
+    pthread_mutex_lock(&heap_lock);
+    switch (key) {
+    case MALLOPT_GROWTH_CHUNK:
+        applied = value >= sizeof(block_header) + MIN_PAYLOAD_SIZE;
+        if (applied) heap_growth_chunk = align_size(value);
+        break;
+    case MALLOPT_SPLIT_THRESHOLD:
+        applied = value >= MIN_PAYLOAD_SIZE;
+        if (applied) split_threshold = align_size(value);
+        break;
+    case MALLOPT_MMAP_THRESHOLD:
+        // Small classes always stay in the heap and its caches
+        applied = value == 0 || value > SMALL_SIZE_MAX;
+        if (applied) __atomic_store_n(&mmap_threshold, value, __ATOMIC_RELAXED);
+        break;
+    case MALLOPT_TRIM_THRESHOLD:
+        trim_threshold = value;
+        break;
+    case MALLOPT_TCACHE_COUNT:
+        applied = value <= UINT32_MAX;
+        if (applied) {
+            __atomic_store_n(&tcache_count_limit, (uint32_t)value, __ATOMIC_RELAXED);
+            // Other threads pick the new count up when they next register
+            if (my_tcache_registered) {
+                my_tcache.limit = (uint32_t)value;
+            }
+        }
+        break;
+    case MALLOPT_ARENA_MAX:
+        applied = value >= 1 && value <= LIFETIME_ARENA_MAX;
+        if (applied) lifetime_arena_limit = (unsigned int)value;
+        break;
+    case MALLOPT_POLICY:
+        applied = value == FIT_FIRST || value == FIT_BEST;
+        if (applied) heap_fit_policy = (fit_policy)value;
+        break;
+    case MALLOPT_FREE_ORDER:
+        applied = value <= FREE_ORDER_SORTED;
+        if (applied) {
+            heap_free_order = (free_order)value;
+            // Both ordered modes start from a sorted list
+            if (value != FREE_ORDER_LIFO) {
+                sort_free_list_locked();
+            }
+        }
+        break;
+    case MALLOPT_COALESCE_DEFER:
+        // Leaving deferred mode settles what is pending
+        if (value == 0 && deferred_frees) {
+            coalesce_sweep_locked();
+        }
+        coalesce_defer = value;
+        break;
+    case MALLOPT_QUICK_COUNT:
+        applied = value <= UINT32_MAX;
+        if (applied) {
+            quick_list_limit = (uint32_t)value;
+            quick_drain_locked();
+        }
+        break;
+    case MALLOPT_LARGE_INDEX:
+        // Large requests must not miss blocks the index cannot hold
+        applied = value == 0 || (value >= sizeof(uint64_t) + MIN_PAYLOAD_SIZE && !heap_fixed);
+        if (applied) {
+            large_index_min = value;
+            large_index_rebuild();
+        }
+        break;
+    case MALLOPT_CONCURRENT_INDEX:
+        // Small classes stay with the thread caches; nodes need mmap
+        applied = value == 0 || (value > SMALL_SIZE_MAX && !heap_fixed);
+        if (applied) {
+            __atomic_store_n(&skip_index_min, value, __ATOMIC_RELAXED);
+            if (value == 0) {
+                skip_drain_locked();
+            }
+        }
+        break;
+    case MALLOPT_TINY_CLASSES:
+        // Tiny pages come from mmap; objects already out stay freeable
+        applied = value <= 1 && !(value && heap_fixed);
+        if (applied) __atomic_store_n(&tiny_classes_enabled, (int)value, __ATOMIC_RELAXED);
+        break;
+    case MALLOPT_LINE_SIZE:
+        // Objects already out keep the line size of their page
+        applied = value == 64 || value == 128;
+        if (applied) __atomic_store_n(&cache_line_size, value, __ATOMIC_RELAXED);
+        break;
+    case MALLOPT_SLAB_COLORING:
+        // Pages keep the offset they were carved with
+        applied = value <= 1;
+        if (applied) __atomic_store_n(&slab_coloring, (int)value, __ATOMIC_RELAXED);
+        break;
+    case MALLOPT_QUICK_SIZE:
+        value = align_size(value);
+        applied = value == 0 || (value > SMALL_SIZE_MAX && quick_extra_count < QUICK_EXTRA_SIZES);
+        if (applied) {
+            // Sizes may be renumbered, so nothing stays parked
+            quick_drain_locked();
+            if (value == 0) {
+                quick_extra_count = 0;
+            } else if (quick_index(value) < 0) {
+                quick_extra_sizes[quick_extra_count++] = value;
+            }
+        }
+        break;
+    default:
+        applied = 0;
+        break;
+    }
+    pthread_mutex_unlock(&heap_lock);
+    return applied;
+}
+
+// Current value of a tunable, 0 for an unknown key
+size_t my_mallopt_get(int key) {
+    switch (key) {
+    case MALLOPT_GROWTH_CHUNK: return heap_growth_chunk;
+    case MALLOPT_SPLIT_THRESHOLD: return split_threshold;
+    case MALLOPT_MMAP_THRESHOLD: return __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+    case MALLOPT_TRIM_THRESHOLD: return trim_threshold;
+    case MALLOPT_TCACHE_COUNT: return __atomic_load_n(&tcache_count_limit, __ATOMIC_RELAXED);
+    case MALLOPT_ARENA_MAX: return lifetime_arena_limit;
+    case MALLOPT_POLICY: return heap_fit_policy;
+    case MALLOPT_FREE_ORDER: return heap_free_order;
+    case MALLOPT_COALESCE_DEFER: return coalesce_defer;
+    case MALLOPT_QUICK_COUNT: return quick_list_limit;
+    case MALLOPT_QUICK_SIZE: return quick_extra_count;
+    case MALLOPT_LARGE_INDEX: return large_index_min;
+    case MALLOPT_CONCURRENT_INDEX: return __atomic_load_n(&skip_index_min, __ATOMIC_RELAXED);
+    case MALLOPT_TINY_CLASSES: return (size_t)__atomic_load_n(&tiny_classes_enabled, __ATOMIC_RELAXED);
+    case MALLOPT_LINE_SIZE: return __atomic_load_n(&cache_line_size, __ATOMIC_RELAXED);
+    case MALLOPT_SLAB_COLORING: return (size_t)__atomic_load_n(&slab_coloring, __ATOMIC_RELAXED);
+    default: return 0;
+    }
+}
+
+// Apply "name:value,name:value" settings. Parsed in place without
+// allocating, since it runs before the heap is in use. Returns 1 when every
+// pair was applied; bad pairs are skipped.
+int my_mallopt_parse(const char* conf) {
+    int all_applied = 1;
+    const char* cursor = conf;
+    
+    while (cursor && *cursor) {
+        const char* end = strchr(cursor, ',');
+        size_t length = end ? (size_t)(end - cursor) : strlen(cursor);
+        const char* colon = memchr(cursor, ':', length);
+        
+        int key = 0;
+        if (colon) {
+            size_t name_length = (size_t)(colon - cursor);
+            for (int k = 1; k < MALLOPT_KEY_COUNT; k++) {
+                if (strlen(mallopt_names[k]) == name_length && strncmp(cursor, mallopt_names[k], name_length) == 0) {
+                    key = k;
+                    break;
+                }
+            }
+        }
+        
+        int applied = 0;
+        if (key) {
+            const char* value_text = colon + 1;
+            size_t value_length = length - (size_t)(value_text - cursor);
+            char* parsed_end = NULL;
+            size_t value = 0;
+            for (size_t i = 0; i < sizeof(mallopt_symbols) / sizeof(mallopt_symbols[0]); i++) {
+                if (mallopt_symbols[i].key == key && strlen(mallopt_symbols[i].name) == value_length &&
+                    strncmp(value_text, mallopt_symbols[i].name, value_length) == 0) {
+                    value = mallopt_symbols[i].value;
+                    parsed_end = (char*)value_text + value_length;
+                }
+            }
+            if (!parsed_end && value_length > 0) {
+                value = (size_t)strtoull(value_text, &parsed_end, 0);
+            }
+            applied = parsed_end == value_text + value_length && my_mallopt(key, value);
+        }
+        all_applied &= applied;
+        
+        cursor = end ? end + 1 : NULL;
+    }
+    return all_applied;
+}
+
+// Apply MYALLOC_CONF before main; getenv does not allocate
+__attribute__((constructor)) void load_env_config(void) {
+    const char* conf = getenv("MYALLOC_CONF");
+    if (conf) {
+        my_mallopt_parse(conf);
+    }
+}
+
+// Turn call-site prediction on or off; what was learned is kept
+void site_prediction_enable(int enabled) {
+    __atomic_store_n(&site_prediction_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+// Find the entry for a site, claiming a slot for it if create is set
+site_entry* site_lookup(const void* site, int create) {
+    size_t hash = ((uintptr_t)site >> 2) * 0x9E3779B97F4A7C15ULL >> 54;
+    for (int probe = 0; probe < SITE_PROBE_LIMIT; probe++) {
+        site_entry* entry = &site_table[(hash + probe) % SITE_TABLE_SIZE];
+        const void* current = __atomic_load_n(&entry->site, __ATOMIC_ACQUIRE);
+        if (current == site) {
+            return entry;
+        }
+        if (current == NULL && create) {
+            const void* expected = NULL;
+            if (__atomic_compare_exchange_n(&entry->site, &expected, site, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || expected == site) {
+                return entry;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Check whether allocations from a site are predicted to be short-lived
+int site_predicted_short(const void* site) {
+    site_entry* entry = site_lookup(site, 0);
+    return entry && __atomic_load_n(&entry->predicted_short, __ATOMIC_RELAXED);
+}
+
+// Allocation in prediction mode: route by the site's prediction, advance
+// the allocation clock and follow every SITE_SAMPLE_INTERVAL-th allocation
+void* site_malloc(size_t size, const void* site) {
+    site_entry* entry = site_lookup(site, 1);
+    void* ptr;
+    if (entry && __atomic_load_n(&entry->predicted_short, __ATOMIC_RELAXED) && !heap_fixed) {
+        ptr = my_malloc_hint(size, LIFETIME_SHORT);
+    } else {
+        ptr = my_malloc_untraced(size);
+    }
+    
+    // The clock is shared, so threads publish their ticks in batches
+    if (++site_clock_pending == SITE_CLOCK_BATCH) {
+        __atomic_fetch_add(&site_clock, SITE_CLOCK_BATCH, __ATOMIC_RELAXED);
+        site_clock_pending = 0;
+    }
+    
+    if (!ptr || !entry || site_sample_countdown-- > 0) {
+        return ptr;
+    }
+    site_sample_countdown = SITE_SAMPLE_INTERVAL - 1;
+    
+    size_t hash = ((uintptr_t)ptr >> 3) * 0x9E3779B97F4A7C15ULL >> 52;
+    for (int probe = 0; probe < SITE_PROBE_LIMIT; probe++) {
+        site_sample* sample = &site_samples[(hash + probe) % SITE_SAMPLE_TABLE_SIZE];
+        void* expected = NULL;
+        if (__atomic_load_n(&sample->ptr, __ATOMIC_RELAXED) == NULL &&
+            __atomic_compare_exchange_n(&sample->ptr, &expected, (void*)1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            // Slot reserved with a placeholder; publish the pointer last
+            sample->site = entry;
+            sample->birth = __atomic_load_n(&site_clock, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&site_samples_live, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&sample->ptr, ptr, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    return ptr;
+}
+
+// If ptr is a followed sample, credit its lifetime to its site
+void site_observe_free(void* ptr) {
+    size_t hash = ((uintptr_t)ptr >> 3) * 0x9E3779B97F4A7C15ULL >> 52;
+    for (int probe = 0; probe < SITE_PROBE_LIMIT; probe++) {
+        site_sample* sample = &site_samples[(hash + probe) % SITE_SAMPLE_TABLE_SIZE];
+        if (__atomic_load_n(&sample->ptr, __ATOMIC_ACQUIRE) != ptr) {
+            continue;
+        }
+        
+        site_entry* entry = sample->site;
+        uint64_t lifetime = __atomic_load_n(&site_clock, __ATOMIC_RELAXED) - sample->birth;
+        __atomic_store_n(&sample->ptr, NULL, __ATOMIC_RELEASE);
+        __atomic_fetch_sub(&site_samples_live, 1, __ATOMIC_RELAXED);
+        
+        uint32_t samples = __atomic_add_fetch(&entry->samples, 1, __ATOMIC_RELAXED);
+        uint32_t shorts = (lifetime < SITE_SHORT_LIFETIME)
+            ? __atomic_add_fetch(&entry->short_samples, 1, __ATOMIC_RELAXED)
+            : __atomic_load_n(&entry->short_samples, __ATOMIC_RELAXED);
+        
+        // Short if at least 7 in 8 samples died young
+        __atomic_store_n(&entry->predicted_short,
+                         samples >= SITE_MIN_SAMPLES && (uint64_t)shorts * 8 >= (uint64_t)samples * 7,
+                         __ATOMIC_RELAXED);
+        
+        // Age the counts so a site whose behaviour changes is relearned
+        if (samples >= SITE_AGING_SAMPLES) {
+            __atomic_store_n(&entry->samples, samples / 2, __ATOMIC_RELAXED);
+            __atomic_store_n(&entry->short_samples, shorts / 2, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+}
+
+// Dump what the predictor has learned per call site
+void print_site_predictions(void) {
+    printf("=== Call-Site Lifetime Predictions ===\n");
+    printf("%-18s %8s %8s %s\n", "site", "samples", "short %", "prediction");
+    for (int i = 0; i < SITE_TABLE_SIZE; i++) {
+        site_entry* entry = &site_table[i];
+        if (!entry->site) continue;
+        printf("%-18p %8u %7.1f%% %s\n", entry->site, entry->samples,
+               entry->samples ? 100.0 * entry->short_samples / entry->samples : 0.0,
+               entry->predicted_short ? "short (churn arena)" : "default");
+    }
+    printf("======================================\n\n");
+}
+
+// Turn false-sharing detection on, dropping what an earlier run saw, or
+// off, keeping it for reporting
+void false_sharing_enable(int enabled) {
+    if (enabled) {
+        for (int i = 0; i < FALSE_SHARING_OBJECTS; i++) {
+            fs_objects[i].writes = 0;
+            fs_objects[i].writers = 0;
+        }
+    }
+    __atomic_store_n(&false_sharing_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+// Turn detection back on after false_sharing_enable(0), keeping the
+// recorded objects and the writes sampled so far
+void false_sharing_resume(void) {
+    __atomic_store_n(&false_sharing_enabled, 1, __ATOMIC_RELAXED);
+}
+
+// Allocation in detection mode: record the object's range and call site
+void* fs_malloc(size_t size, const void* site) {
+    void* ptr = my_malloc_untraced(size);
+    if (!ptr) {
+        return NULL;
+    }
+    
+    uintptr_t first = (uintptr_t)ptr / FALSE_SHARING_LINE;
+    uintptr_t last = ((uintptr_t)ptr + size - 1) / FALSE_SHARING_LINE;
+    fs_object* object = fs_claim_slot(first);
+    if (!object) {
+        return ptr;
+    }
+    object->size = size;
+    object->site = site;
+    object->writes = 0;
+    object->writers = 0;
+    object->owner = NULL;
+    __atomic_fetch_add(&fs_objects_live, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&object->ptr, ptr, __ATOMIC_RELEASE);
+    
+    // Without an edge entry, writes to the last line go uncounted
+    fs_object* edge = last != first ? fs_claim_slot(last) : NULL;
+    if (edge) {
+        edge->size = size;
+        edge->site = site;
+        edge->writes = 0;
+        edge->writers = 0;
+        edge->owner = object;
+        __atomic_store_n(&edge->ptr, ptr, __ATOMIC_RELEASE);
+    }
+    return ptr;
+}
+
+// Home slot of a cache line in the detector's table
+size_t fs_hash(uintptr_t line) {
+    return (size_t)(line * 0x9E3779B97F4A7C15ULL >> FALSE_SHARING_HASH_SHIFT);
+}
+
+// Reserve an empty slot among a line's probes with a placeholder pointer;
+// the caller fills it in and publishes the pointer last. NULL when full.
+fs_object* fs_claim_slot(uintptr_t line) {
+    size_t hash = fs_hash(line);
+    for (int probe = 0; probe < FALSE_SHARING_PROBE_LIMIT; probe++) {
+        fs_object* object = &fs_objects[(hash + probe) % FALSE_SHARING_OBJECTS];
+        void* expected = NULL;
+        if (__atomic_load_n(&object->ptr, __ATOMIC_RELAXED) == NULL &&
+            __atomic_compare_exchange_n(&object->ptr, &expected, (void*)1, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            return object;
+        }
+    }
+    return NULL;
+}
+
+// Main entry of the followed object holding addr, looked up among the
+// entries of addr's line. Interior lines of objects spanning three lines
+// or more have no entry; nothing else lives on them.
+fs_object* fs_find(uintptr_t line, const char* addr) {
+    size_t hash = fs_hash(line);
+    for (int probe = 0; probe < FALSE_SHARING_PROBE_LIMIT; probe++) {
+        fs_object* object = &fs_objects[(hash + probe) % FALSE_SHARING_OBJECTS];
+        char* ptr = __atomic_load_n(&object->ptr, __ATOMIC_ACQUIRE);
+        if (ptr > (char*)1 && addr >= ptr && addr < ptr + object->size) {
+            return object->owner ? object->owner : object;
+        }
+    }
+    return NULL;
+}
+
+// Stop following ptr if the detector recorded it
+void fs_forget(void* ptr) {
+    uintptr_t line = (uintptr_t)ptr / FALSE_SHARING_LINE;
+    fs_object* object = fs_find(line, (const char*)ptr);
+    if (!object || object->ptr != ptr) {
+        return;
+    }
+    
+    uintptr_t last = ((uintptr_t)ptr + object->size - 1) / FALSE_SHARING_LINE;
+    if (last != line) {
+        size_t hash = fs_hash(last);
+        for (int probe = 0; probe < FALSE_SHARING_PROBE_LIMIT; probe++) {
+            fs_object* edge = &fs_objects[(hash + probe) % FALSE_SHARING_OBJECTS];
+            if (edge->owner == object && __atomic_load_n(&edge->ptr, __ATOMIC_ACQUIRE) == ptr) {
+                __atomic_store_n(&edge->ptr, NULL, __ATOMIC_RELEASE);
+                break;
+            }
+        }
+    }
+    __atomic_store_n(&object->ptr, NULL, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&fs_objects_live, 1, __ATOMIC_RELAXED);
+}
+
+// Credit a sampled write to the recorded object holding addr. Interior
+// addresses are allowed; only the slots of addr's line are searched.
+void false_sharing_sample(const void* addr) {
+    false_sharing_countdown = FALSE_SHARING_SAMPLE_INTERVAL - 1;
+    if (fs_thread_bit == 0) {
+        fs_thread_bit = (uint64_t)1 << (__atomic_fetch_add(&fs_threads_seen, 1, __ATOMIC_RELAXED) % 64);
+    }
+    
+    fs_object* object = fs_find((uintptr_t)addr / FALSE_SHARING_LINE, (const char*)addr);
+    if (object) {
+        __atomic_fetch_add(&object->writes, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_or(&object->writers, fs_thread_bit, __ATOMIC_RELAXED);
+    }
+}
+
+// Written object sharing a cache line with object, where some thread
+// writes one of them while another thread writes the other; NULL if none.
+// Only the object's first and last lines can hold anything else, so only
+// their slots are searched.
+const fs_object* fs_line_neighbour(const fs_object* object) {
+    uintptr_t first = (uintptr_t)object->ptr / FALSE_SHARING_LINE;
+    uintptr_t last = ((uintptr_t)object->ptr + object->size - 1) / FALSE_SHARING_LINE;
+    
+    for (uintptr_t line = first; ; line = last) {
+        size_t hash = fs_hash(line);
+        for (int probe = 0; probe < FALSE_SHARING_PROBE_LIMIT; probe++) {
+            const fs_object* entry = &fs_objects[(hash + probe) % FALSE_SHARING_OBJECTS];
+            char* ptr = __atomic_load_n(&entry->ptr, __ATOMIC_ACQUIRE);
+            const fs_object* other = entry->owner ? entry->owner : entry;
+            if (other == object || ptr <= (char*)1 || other->writes == 0) {
+                continue;
+            }
+            uintptr_t other_first = (uintptr_t)ptr / FALSE_SHARING_LINE;
+            uintptr_t other_last = ((uintptr_t)ptr + entry->size - 1) / FALSE_SHARING_LINE;
+            if (other_first <= line && line <= other_last &&
+                __builtin_popcountll(object->writers | other->writers) >= 2) {
+                return other;
+            }
+        }
+        if (line == last) {
+            return NULL;
+        }
+    }
+}
+
+// Fill entries with up to max falsely shared objects; returns how many
+size_t false_sharing_collect(false_sharing_entry* entries, size_t max) {
+    size_t count = 0;
+    for (int i = 0; i < FALSE_SHARING_OBJECTS && count < max; i++) {
+        const fs_object* object = &fs_objects[i];
+        char* ptr = __atomic_load_n(&object->ptr, __ATOMIC_ACQUIRE);
+        if (ptr <= (char*)1 || object->owner || object->writes == 0) {
+            continue;
+        }
+        const fs_object* neighbour = fs_line_neighbour(object);
+        if (!neighbour) {
+            continue;
+        }
+        entries[count].object = ptr;
+        entries[count].size = object->size;
+        entries[count].site = object->site;
+        entries[count].writes = object->writes;
+        entries[count].threads = (uint32_t)__builtin_popcountll(object->writers);
+        entries[count].neighbour = neighbour->ptr;
+        entries[count].neighbour_site = neighbour->site;
+        count++;
+    }
+    return count;
+}
+
+// List the falsely shared objects with their call sites
+void print_false_sharing(void) {
+    false_sharing_entry entries[64];
+    size_t count = false_sharing_collect(entries, 64);
+    
+    printf("=== False Sharing ===\n");
+    printf("%-18s %6s %-18s %7s %7s %-18s %-18s\n",
+           "object", "size", "site", "writes", "threads", "neighbour", "neighbour site");
+    for (size_t i = 0; i < count; i++) {
+        printf("%-18p %6zu %-18p %7u %7u %-18p %-18p\n", entries[i].object, entries[i].size,
+               entries[i].site, entries[i].writes, entries[i].threads,
+               entries[i].neighbour, entries[i].neighbour_site);
+    }
+    if (count == 0) {
+        printf("No falsely shared objects sampled\n");
+    }
+    printf("=====================\n\n");
+}
+
+// Lifetime of the arena holding ptr; LIFETIME_DEFAULT for the main heap
+lifetime_hint lifetime_of(const void* ptr) {
+    if (!is_lifetime_address(ptr)) {
+        return LIFETIME_DEFAULT;
+    }
+    return (lifetime_hint)lifetime_kind[((const char*)ptr - lifetime_base) / LIFETIME_ARENA_SIZE];
+}
+
+// Payload bytes live in the arenas of one lifetime
+size_t lifetime_live_bytes(lifetime_hint hint) {
+    size_t live = 0;
+    pthread_mutex_lock(&lifetime_lock);
+    for (unsigned int slot = 0; slot < lifetime_slots_used; slot++) {
+        if (lifetime_kind[slot] == hint) {
+            live += lifetime_arena(slot)->live_bytes;
+        }
+    }
+    pthread_mutex_unlock(&lifetime_lock);
+    return live;
+}
+
+// Summarize the main heap's blocks
+void get_heap_stats(heap_stats* stats) {
+    if (!stats) return;
+    memset(stats, 0, sizeof(*stats));
+    
+    pthread_mutex_lock(&heap_lock);
+    stats_range(stats, (char*)&heap_seed, (char*)&heap_seed + sizeof(heap_seed));
+    if (heap_start) {
+        stats->heap_size = (size_t)((char*)heap_end - (char*)heap_start);
+        stats_range(stats, (char*)heap_start, (char*)heap_end);
+    }
+    stats->pressure_events = heap_pressure_events;
+    stats->limit_failures = heap_limit_failures;
+    stats->mapped_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+    stats->merges = heap_merges;
+    stats->coalesce_sweeps = coalesce_sweeps;
+    stats->quick_blocks = quick_held;
+    stats->parked_blocks = __atomic_load_n(&skip_count, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&heap_lock);
+}
+
+// Add the blocks between start and end to stats. Caller holds heap_lock.
+void stats_range(heap_stats* stats, char* start, char* end) {
+    block_header* current = (block_header*)start;
+    while ((char*)current < end) {
+        if (current->is_free) {
+            stats->free_bytes += current->payload_size;
+            stats->free_blocks++;
+            if (current->payload_size > stats->largest_free) {
+                stats->largest_free = current->payload_size;
+            }
+        } else {
+            stats->allocated_blocks++;
+        }
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+}
+
+// Validate heap integrity (for debugging)
+int validate_heap() {
+    pthread_mutex_lock(&heap_lock);
+    int valid = validate_heap_locked();
+    pthread_mutex_unlock(&heap_lock);
+    return valid;
+}
+
+// Heap walk behind validate_heap. Caller holds heap_lock.
+int validate_heap_locked(void) {
+    if (!validate_range((char*)&heap_seed, (char*)&heap_seed + sizeof(heap_seed))) {
+        return 0;
+    }
+    if (heap_start && !validate_range((char*)heap_start, (char*)heap_end)) {
+        return 0;
+    }
+    
+    // Every index entry must describe a free block at its recorded size
+    for (size_t i = 0; large_index_min && i < large_count; i++) {
+        block_header* block = large_blocks[i];
+        if (!block->is_free || block->payload_size != large_sizes[i] || !large_index_holds(block)) {
+            fprintf(stderr, "Heap corruption detected: stale large index entry\n");
+            return 0;
+        }
+    }
+    
+    // Every parked node must describe a parked block, in index order
+    int parked_valid = 1;
+    pthread_mutex_lock(&skip_lock);
+    for (skip_node* node = skip_head.next[0]; node && parked_valid; node = node->next[0]) {
+        parked_valid = node->block->magic == MAGIC_PARKED && node->block->payload_size == node->size &&
+                       (!node->next[0] || !skip_before(node->next[0], node->size, node->block));
+    }
+    pthread_mutex_unlock(&skip_lock);
+    if (!parked_valid) {
+        fprintf(stderr, "Heap corruption detected: bad concurrent index entry\n");
+        return 0;
+    }
+    
+    // Tiny and line pages with room must have as many free bits as free slots
+    for (unsigned int cls = 0; cls < TINY_CLASS_COUNT + LINE_CLASS_COUNT; cls++) {
+        tiny_class* tc = cls < TINY_CLASS_COUNT ? &tiny_classes[cls] : &line_classes[cls - TINY_CLASS_COUNT];
+        if (!tiny_class_valid(tc)) {
+            fprintf(stderr, "Heap corruption detected: tiny page bitmap out of step\n");
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+// Walk the blocks between start and end. Caller holds heap_lock.
+int validate_range(char* start, char* end) {
+    block_header* current = (block_header*)start;
+    
+    while ((char*)current < end) {
+        // Check magic number
+        if (current->magic != MAGIC_FREE && current->magic != MAGIC_ALLOCATED &&
+            current->magic != MAGIC_CACHED && current->magic != MAGIC_HANDLE &&
+            current->magic != MAGIC_QUICK && current->magic != MAGIC_PARKED) {
+            fprintf(stderr, "Heap corruption detected: invalid magic number\n");
+            return 0;
+        }
+        
+        // Check if block extends beyond heap
+        if ((char*)current + sizeof(block_header) + current->payload_size > end) {
+            fprintf(stderr, "Heap corruption detected: block extends beyond heap\n");
+            return 0;
+        }
+        
+        current = (block_header*)((char*)current + sizeof(block_header) + current->payload_size);
+    }
+    
+    return 1; // Heap is valid
+}
+
+// Debug function to print heap state
+void print_heap_debug() {
+    printf("=== Heap Debug Info ===\n");
     printf("Heap start: %p\n", heap_start);
     printf("Heap end: %p\n", heap_end);
     printf("Heap size: %zu bytes\n", (char*)heap_end - (char*)heap_start);
@@ -360,6 +4192,7 @@ void print_heap_debug() {
         return;
     }
     
+    pthread_mutex_lock(&heap_lock);
     printf("\nBlocks in memory:\n");
     block_header* current = (block_header*)heap_start;
     int block_num = 0;
@@ -380,5 +4213,27 @@ void print_heap_debug() {
                block_num++, current, current->payload_size);
         current = current->next;
     }
+    pthread_mutex_unlock(&heap_lock);
     printf("======================\n\n");
-}
\ No newline at end of file
+}
+
+// Print the size-class table with the worst-case internal waste per class
+void print_size_classes(void) {
+    printf("=== Size Classes ===\n");
+    printf("spacing=%d, small max=%d, classes=%d\n\n",
+           SIZE_CLASS_SPACING, SMALL_SIZE_MAX, SIZE_CLASS_COUNT);
+    printf("%5s %6s %13s %11s %9s\n", "class", "size", "requests", "max waste", "waste %");
+    
+    size_t prev = 0;
+    for (int i = 0; i < SIZE_CLASS_COUNT; i++) {
+        size_t size = size_class_sizes[i];
+        // Smallest aligned request that still lands in this class
+        size_t smallest = align_size(prev + 1);
+        size_t waste = size - smallest;
+        printf("%5d %6zu %6zu-%-6zu %11zu %8.1f%%\n",
+               i, size, prev + 1, size, waste, 100.0 * waste / size);
+        prev = size;
+    }
+    printf("Block header: %zu bytes per allocation\n", sizeof(block_header));
+    printf("====================\n\n");
+}
@@ -0,0 +1,580 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Block header placed in front of every heap payload. It is public so the
+// inline fast paths below can reach it without a call into allocator.c.
+typedef struct block_header {
+    size_t payload_size;
+    struct block_header* next;
+    struct block_header* prev;
+    uint16_t is_free;
+    uint16_t tag;    // Allocation tag, 0 if untagged
+    uint32_t magic;  // For debugging and corruption detection
+} block_header;
+
+#define MAGIC_FREE 0xDEADBEEF
+#define MAGIC_ALLOCATED 0xFEEDFACE
+#define MAGIC_CACHED 0xCAC4EB10  // Parked in a cache, still allocated to the heap
+#define MAGIC_HANDLE 0x4A4D0B1E  // Allocated through a handle, movable when unpinned
+#define MAGIC_REGION 0xFEEDF00D  // Allocated from a region heap
+#define MAGIC_MAPPED 0x4D415050  // Large allocation in its own mapping
+#define MAGIC_QUICK 0xFA57B10C   // On a heap quick list, still allocated to the heap
+#define MAGIC_PARKED 0x5C1B0A7D  // In the concurrent large-block index, still allocated to the heap
+#define MAGIC_COMPRESSED 0xC0DE3200  // Allocated from a compressed heap
+
+// Slab pages are SLAB_PAGE_SIZE bytes and aligned to their own size, so the
+// page owning any object is found by masking the object address.
+#define SLAB_PAGE_SIZE 16384
+#define SLAB_PAGE_MAGIC 0x51AB51ABu
+
+// Slab coloring: a page with whole SLAB_COLOR_STEP-byte lines to spare past
+// its last object shifts its first object by some of them, a different
+// number on each new page of a class, so the hot first objects of many
+// pages do not all map to the same cache sets.
+#define SLAB_COLOR_STEP 64
+
+// Header at the start of every slab page; the rest of the page belongs to
+// whoever carved it (a pool, a size class, ...).
+typedef struct slab_header {
+    struct slab_header* next;   // Owner's list of pages
+    void* owner;                // Pool or class that carved the page
+    uint32_t magic;             // SLAB_PAGE_MAGIC while in use
+    uint32_t object_size;       // Stride of the objects on the page
+} slab_header;
+
+// Size classes. The whole table is derived from this spec at compile time:
+// classes are SIZE_CLASS_SPACING apart up to SIZE_CLASS_STEPS * spacing, then
+// SIZE_CLASS_STEPS classes per doubling up to SMALL_SIZE_MAX.
+#define SIZE_CLASS_SPACING 16
+#define SMALL_SIZE_MAX 1024
+#define SIZE_CLASS_COUNT 20
+#define SIZE_CLASS_STEPS 4
+
+// Table capacities; the generated arrays are this long
+#define SIZE_CLASS_CAPACITY 32
+#define SIZE_CLASS_LOOKUP_SLOTS 128
+
+// Size of class i (plain integer arithmetic so #if can check the spec)
+#define SC_LINEAR_MAX (SIZE_CLASS_STEPS * SIZE_CLASS_SPACING)
+#define SC_GROUP(i) (((i) < SIZE_CLASS_STEPS ? 0 : (i) - SIZE_CLASS_STEPS) / SIZE_CLASS_STEPS)
+#define SC_GROUP_BASE(i) (SC_LINEAR_MAX << SC_GROUP(i))
+#define SIZE_CLASS_SIZE(i) \
+    ((i) < SIZE_CLASS_STEPS ? ((i) + 1) * SIZE_CLASS_SPACING \
+     : SC_GROUP_BASE(i) + (((i) - SIZE_CLASS_STEPS) % SIZE_CLASS_STEPS + 1) * (SC_GROUP_BASE(i) / SIZE_CLASS_STEPS))
+
+// Class serving a request of s bytes (s <= SMALL_SIZE_MAX), the inverse of
+// SIZE_CLASS_SIZE; SC_LOG2 is floor(log2(q)) for q < 65536.
+#define SC_LOG2(q) \
+    (((q) >= 2) + ((q) >= 4) + ((q) >= 8) + ((q) >= 16) + ((q) >= 32) + ((q) >= 64) + \
+     ((q) >= 128) + ((q) >= 256) + ((q) >= 512) + ((q) >= 1024) + ((q) >= 2048) + \
+     ((q) >= 4096) + ((q) >= 8192) + ((q) >= 16384) + ((q) >= 32768))
+#define SC_CLASS_GROUP(s) SC_LOG2(((s) - 1) / SC_LINEAR_MAX)
+#define SC_CLASS_OF(s) \
+    ((s) > SMALL_SIZE_MAX ? SIZE_CLASS_COUNT \
+     : (s) <= SC_LINEAR_MAX ? ((s) == 0 ? 0 : ((s) - 1) / SIZE_CLASS_SPACING) \
+     : SIZE_CLASS_STEPS * (1 + SC_CLASS_GROUP(s)) + \
+       ((s) - 1 - (SC_LINEAR_MAX << SC_CLASS_GROUP(s))) / ((SC_LINEAR_MAX << SC_CLASS_GROUP(s)) / SIZE_CLASS_STEPS))
+
+#if SIZE_CLASS_SIZE(SIZE_CLASS_COUNT - 1) != SMALL_SIZE_MAX
+#error "SIZE_CLASS_COUNT does not match SIZE_CLASS_SPACING and SMALL_SIZE_MAX"
+#endif
+#if SIZE_CLASS_COUNT > SIZE_CLASS_CAPACITY || SMALL_SIZE_MAX / SIZE_CLASS_SPACING >= SIZE_CLASS_LOOKUP_SLOTS
+#error "Size-class spec exceeds the generated table capacity"
+#endif
+
+// Dense tables generated from the spec, defined in allocator.c
+extern const uint32_t size_class_sizes[SIZE_CLASS_CAPACITY];
+extern const uint8_t size_class_lookup[SIZE_CLASS_LOOKUP_SLOTS];
+
+// Branch-free size-to-class mapping, valid for size <= SMALL_SIZE_MAX
+static inline unsigned int size_to_class(size_t size) {
+    return size_class_lookup[(size + SIZE_CLASS_SPACING - 1) / SIZE_CLASS_SPACING];
+}
+
+// Heap API
+void* init_allocator(size_t initial_size);
+
+// Run the heap on a caller-provided buffer (a static array, a pre-mlocked
+// region) instead of sbrk. Must be called before the first allocation; the
+// heap then never grows, so allocations fail once the buffer is exhausted
+// and no system call is made on the allocation paths. The free part of the
+// static seed is retired, so the buffer is the whole capacity. Lifetime
+// hints fall back to the main heap, and slab pages, tiny classes and line
+// classes are unavailable.
+void* init_allocator_fixed(void* buffer, size_t size);
+void* init_allocator_locked(size_t size);
+void* my_malloc(size_t size);
+void my_free(void* payload_ptr);
+
+// Out-of-line paths taken when the thread cache cannot serve a request
+void* my_malloc_slow(size_t size);
+void my_free_slow(void* payload_ptr);
+
+// Per-thread cache of small blocks, one LIFO bin per size class. Cached
+// blocks stay allocated as far as the heap is concerned, so they are never
+// coalesced. limit starts at zero, which sends a thread's first free through
+// the slow path where the cache is registered for flushing at thread exit.
+#define TCACHE_COUNT_MAX 32
+
+typedef struct thread_cache {
+    block_header* bins[SIZE_CLASS_COUNT];
+    uint32_t counts[SIZE_CLASS_COUNT];
+    uint32_t limit;
+} thread_cache;
+
+extern __thread thread_cache my_tcache;
+
+void tcache_flush(void);
+
+// Park a block in the thread cache; returns 0 if it does not qualify
+static inline int tcache_push(block_header* block) {
+    size_t payload = block->payload_size;
+    // One unsigned compare for SIZE_CLASS_SPACING <= payload <= SMALL_SIZE_MAX
+    if (payload - SIZE_CLASS_SPACING > SMALL_SIZE_MAX - SIZE_CLASS_SPACING) {
+        return 0;
+    }
+    
+    // Largest class the payload can hold
+    unsigned int cls = size_to_class(payload + 1) - 1;
+    if (my_tcache.counts[cls] >= my_tcache.limit) {
+        return 0;
+    }
+    
+    block->magic = MAGIC_CACHED;
+    block->next = my_tcache.bins[cls];
+    my_tcache.bins[cls] = block;
+    my_tcache.counts[cls]++;
+    return 1;
+}
+
+// Small-size malloc served straight from the thread cache
+static inline void* my_malloc_inline(size_t size) {
+    // One unsigned compare for 0 < size <= SMALL_SIZE_MAX
+    if (size - 1 < SMALL_SIZE_MAX) {
+        unsigned int cls = size_to_class(size);
+        block_header* block = my_tcache.bins[cls];
+        if (block) {
+            my_tcache.bins[cls] = block->next;
+            my_tcache.counts[cls]--;
+            block->next = NULL;
+            block->magic = MAGIC_ALLOCATED;
+            return (char*)block + sizeof(block_header);
+        }
+    }
+    return my_malloc_slow(size);
+}
+
+// Free that parks small blocks in the thread cache
+static inline void my_free_inline(void* payload_ptr) {
+    if (payload_ptr) {
+        block_header* block = (block_header*)((char*)payload_ptr - sizeof(block_header));
+        // Tagged blocks take the slow path so their tag is accounted
+        if (block->magic == MAGIC_ALLOCATED && block->tag == 0 && tcache_push(block)) {
+            return;
+        }
+    }
+    my_free_slow(payload_ptr);
+}
+
+// Slab page API
+void* slab_page_alloc(void);
+void slab_page_free(void* page);
+int is_slab_page_address(const void* ptr);
+
+// Tiny size classes. With tiny_classes on, my_malloc serves requests of up
+// to TINY_SIZE_MAX bytes from slab pages of 8, 12, 16 or 24-byte objects
+// with no per-object header: a bitmap at the front of each page marks the
+// free slots, and my_free finds the page by masking the address. Objects
+// are aligned to the largest power of two dividing their size, up to 8.
+#define TINY_SIZE_MAX 24
+#define TINY_CLASS_COUNT 4
+
+typedef struct tiny_stats {
+    size_t object_size;
+    size_t objects;         // Live objects
+    size_t pages;           // Slab pages held by the class
+} tiny_stats;
+
+void get_tiny_stats(unsigned int cls, tiny_stats* stats);
+void print_tiny_stats(void);
+
+// Cache-line classes. my_malloc_lines rounds a request up to whole cache
+// lines and serves it from slab pages where each object starts on a line
+// boundary and shares its lines with nothing, not even a header, so objects
+// written by different threads never falsely share a line. The line size is
+// the line_size tunable: 64, or 128 where the adjacent-line prefetcher pulls
+// lines in pairs. Requests over LINE_CLASS_LINES lines get NULL, and so does
+// every request on a fixed heap, which maps no slab pages. Objects are
+// released with my_free.
+#define LINE_CLASS_LINES 8
+
+void* my_malloc_lines(size_t size);
+
+// Lifetime hints. Objects of each hinted lifetime are placed in their own
+// region-heap arenas, so long-lived data packs densely instead of pinning
+// holes between short-lived churn, and a short-lived arena that empties out
+// has its pages returned. my_free accepts hinted allocations.
+typedef enum lifetime_hint {
+    LIFETIME_DEFAULT = 0,   // Main heap
+    LIFETIME_SHORT,
+    LIFETIME_LONG,
+    LIFETIME_PERMANENT,
+    LIFETIME_KIND_COUNT
+} lifetime_hint;
+
+#define LIFETIME_ARENA_SIZE (1UL << 20)
+#define LIFETIME_ARENA_MAX 256
+
+void* my_malloc_hint(size_t size, lifetime_hint hint);
+lifetime_hint lifetime_of(const void* ptr);
+size_t lifetime_live_bytes(lifetime_hint hint);
+
+// Allocation tags. Each tagged allocation records its tag in the block
+// header; live bytes and operation counts are kept per tag in per-thread
+// shards so accounting adds no shared cache line to the allocation path.
+// A tag can carry a soft limit (the callback is told when it is crossed)
+// and a hard limit (the callback is told and the allocation fails).
+// Tags come from my_malloc_tagged or from the calling thread's current tag,
+// which applies to my_malloc.
+#define ALLOC_TAG_MAX 64    // Tag 0 means untagged
+#define TAG_SHARDS 16
+
+typedef void (*tag_limit_callback)(unsigned int tag, size_t live_bytes, size_t request, int hard);
+
+typedef struct tag_stats {
+    int64_t live_bytes;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failures;      // Allocations refused by the hard limit
+} tag_stats;
+
+void* my_malloc_tagged(size_t size, unsigned int tag);
+unsigned int alloc_tag_enter(unsigned int tag);
+void alloc_tag_leave(unsigned int previous);
+int alloc_tag_set_limit(unsigned int tag, size_t soft_limit, size_t hard_limit, tag_limit_callback callback);
+void alloc_tag_stats(unsigned int tag, tag_stats* stats);
+void print_tag_stats(void);
+
+// Heap limits and memory pressure. Growing the heap past the soft limit (or
+// while the watched cgroup reports pressure) first relieves pressure: the
+// calling thread's caches are flushed, registered shrinkers are asked to
+// release memory, free pages are purged and the heap tail is trimmed. Growth
+// past the hard limit fails instead of waiting for the OOM killer.
+#define HEAP_SHRINKER_MAX 8
+#define HEAP_PRESSURE_POLL 16   // Expansions between cgroup pressure reads
+
+// Asked to release about wanted bytes; returns the bytes it freed
+typedef size_t (*heap_shrinker)(size_t wanted, void* arg);
+
+void heap_set_limits(size_t soft_limit, size_t hard_limit);
+int heap_add_shrinker(heap_shrinker shrinker, void* arg);
+int heap_remove_shrinker(heap_shrinker shrinker, void* arg);
+int heap_watch_cgroup_pressure(const char* path, double threshold);
+size_t heap_relieve_pressure(size_t wanted);
+
+// Runtime tuning. MYALLOC_CONF is read before main as comma-separated
+// name:value pairs, e.g. MYALLOC_CONF="growth_chunk:65536,policy:best";
+// my_mallopt changes the same settings at run time.
+typedef enum mallopt_key {
+    MALLOPT_GROWTH_CHUNK = 1,   // growth_chunk: least the heap grows by
+    MALLOPT_SPLIT_THRESHOLD,    // split_threshold: least payload split off a block
+    MALLOPT_MMAP_THRESHOLD,     // mmap_threshold: requests this large are mapped; 0 never
+    MALLOPT_TRIM_THRESHOLD,     // trim_threshold: free tail trimmed on free; 0 never
+    MALLOPT_TCACHE_COUNT,       // tcache_count: blocks cached per class and thread
+    MALLOPT_ARENA_MAX,          // arena_max: lifetime arenas that may be opened
+    MALLOPT_POLICY,             // policy: first or best
+    MALLOPT_FREE_ORDER,         // free_order: lifo, address or sorted
+    MALLOPT_COALESCE_DEFER,     // coalesce_defer: frees between merge sweeps; 0 merges on free
+    MALLOPT_QUICK_COUNT,        // quick_count: blocks per exact-size quick list; 0 none
+    MALLOPT_QUICK_SIZE,         // quick_size: add a large exact size; 0 clears them
+    MALLOPT_LARGE_INDEX,        // large_index: least payload kept in the size index; 0 off
+    MALLOPT_CONCURRENT_INDEX,   // concurrent_index: least payload parked in the concurrent index; 0 off
+    MALLOPT_TINY_CLASSES,       // tiny_classes: 1 serves requests up to TINY_SIZE_MAX from tiny slabs
+    MALLOPT_LINE_SIZE,          // line_size: cache line my_malloc_lines rounds to, 64 or 128
+    MALLOPT_SLAB_COLORING,      // slab_coloring: 1 rotates the first object of new tiny and line pages
+    MALLOPT_KEY_COUNT
+} mallopt_key;
+
+typedef enum fit_policy {
+    FIT_FIRST = 0,
+    FIT_BEST
+} fit_policy;
+
+// Free-list order. LIFO pushes freed blocks at the head. ADDRESS keeps the
+// list sorted on every insert, so first fit hands out the lowest block and
+// consecutive allocations end up next to each other. SORTED pushes at the
+// head and sorts the whole list every FREE_SORT_INTERVAL frees, or when the
+// application calls sort_free_list while idle.
+typedef enum free_order {
+    FREE_ORDER_LIFO = 0,
+    FREE_ORDER_ADDRESS,
+    FREE_ORDER_SORTED
+} free_order;
+
+#define FREE_SORT_INTERVAL 1024
+
+// Exact-size quick lists. Blocks freed at exactly a size class, or at one of
+// up to QUICK_EXTRA_SIZES registered larger sizes, are parked on a LIFO list
+// for that size instead of the free list. They stay allocated as far as the
+// heap is concerned, so they are never split or merged, and an allocation
+// of the same size pops one without searching. The lists are drained back
+// into the heap when an allocation misses and under memory pressure.
+#define QUICK_EXTRA_SIZES 8
+
+// Large free-block index. Free blocks of at least large_index bytes are
+// mirrored in two packed arrays, sizes and block addresses, so a large
+// request is served by scanning contiguous sizes (four per AVX2 compare
+// where the CPU has it) instead of chasing free-list pointers through the
+// heap. Each indexed block keeps its slot number in its first payload word.
+#define LARGE_INDEX_INITIAL 256
+
+// Concurrent large-block index. Freed blocks of at least concurrent_index
+// bytes bypass heap_lock: they are parked in a skip list ordered by size and
+// address whose searches take no lock, and an allocation claims the best
+// fitting block with a compare-and-swap on its node, so threads claim
+// different large blocks in parallel. Only linking and unlinking nodes is
+// serialized, on a lock of its own. A claim tries the first
+// SKIP_CLAIM_PROBES candidates before giving up to the heap. Parked blocks
+// stay allocated as far as the heap is concerned and are handed back when
+// an allocation misses and under memory pressure.
+#define SKIP_MAX_LEVEL 16
+#define SKIP_CLAIM_PROBES 8
+#define SKIP_READER_SHARDS 16
+
+int my_mallopt(int key, size_t value);
+size_t my_mallopt_get(int key);
+int my_mallopt_parse(const char* conf);
+void sort_free_list(void);
+
+// Large index search behind the fit policy; caller holds heap_lock. The
+// AVX2 scan is chosen on the first search (large_use_avx2 -1); 0 forces
+// the scalar scan.
+extern int large_use_avx2;
+block_header* large_index_find(size_t required_size);
+
+// Call-site lifetime prediction. When enabled, my_malloc keys allocations by
+// return address, samples one allocation in SITE_SAMPLE_INTERVAL per thread
+// and measures how many allocations happen before the sample is freed.
+// Sites whose samples are consistently short-lived are routed to the
+// LIFETIME_SHORT arenas without any change at the call site.
+#define SITE_SAMPLE_INTERVAL 64
+#define SITE_SHORT_LIFETIME 4096    // Allocations; anything freed sooner is short
+#define SITE_MIN_SAMPLES 8
+
+void site_prediction_enable(int enabled);
+int site_predicted_short(const void* site);
+void print_site_predictions(void);
+
+// False-sharing detection. While enabled, my_malloc records the range and
+// call site of each allocation, up to FALSE_SHARING_OBJECTS live at once.
+// Writes are sampled in software: code under analysis reports its stores
+// with false_sharing_note_write, which keeps one in
+// FALSE_SHARING_SAMPLE_INTERVAL per thread and credits it, with the writing
+// thread, to the recorded allocation holding the address. An object is
+// reported when it shares a FALSE_SHARING_LINE-byte line with another
+// written object and the two are written by different threads. Objects
+// are indexed by the lines they start and end on, so sampling a write and
+// checking an object's neighbours cost a few probes each. Threads are told
+// apart by one bit each, modulo 64: threads 64 apart look like one thread,
+// so sharing between just those two goes unreported.
+#define FALSE_SHARING_OBJECTS 4096
+#define FALSE_SHARING_SAMPLE_INTERVAL 16
+#define FALSE_SHARING_LINE 64
+
+typedef struct false_sharing_entry {
+    const void* object;
+    size_t size;
+    const void* site;           // Caller of my_malloc
+    uint32_t writes;            // Sampled writes
+    uint32_t threads;           // Distinct writing threads seen
+    const void* neighbour;      // Object on a shared line written by another thread
+    const void* neighbour_site;
+} false_sharing_entry;
+
+extern int false_sharing_enabled;
+extern __thread uint32_t false_sharing_countdown;
+
+void false_sharing_enable(int enabled);
+void false_sharing_resume(void);
+void false_sharing_sample(const void* addr);
+size_t false_sharing_collect(false_sharing_entry* entries, size_t max);
+void print_false_sharing(void);
+
+// Report a store to addr; sampled only while detection is on
+static inline void false_sharing_note_write(const void* addr) {
+    if (__builtin_expect(__atomic_load_n(&false_sharing_enabled, __ATOMIC_RELAXED), 0) &&
+        false_sharing_countdown-- == 0) {
+        false_sharing_sample(addr);
+    }
+}
+
+// Handle-based movable allocations. A handle names an allocation that the
+// compactor may move while it is unpinned; handle_pin returns its current
+// address and keeps it in place until the matching handle_unpin.
+typedef uint32_t mem_handle;   // 0 is never a valid handle
+
+mem_handle handle_alloc(size_t size);
+void handle_free(mem_handle handle);
+void* handle_pin(mem_handle handle);
+void handle_unpin(mem_handle handle);
+
+// Compaction slides unpinned handle blocks toward heap_start so free space
+// merges at the top of the heap, then trims that tail. Each step moves at
+// most max_bytes so pauses stay bounded; it returns 1 once a full pass over
+// the heap has completed. compact_heap runs steps until the pass is done.
+int compact_heap_step(size_t max_bytes);
+void compact_heap(void);
+size_t trim_heap(void);
+
+// Ring (FIFO) allocator for buffers that are freed roughly in allocation
+// order. Allocation bumps the head of a circular buffer mapped outside the
+// heap; frees mark entries and the tail advances over every freed entry, so
+// slightly out-of-order frees are reclaimed once the older ones arrive.
+// Requests that do not fit before the tail fall back to my_malloc.
+typedef struct ring_allocator {
+    char* buffer;
+    size_t capacity;
+    size_t head;        // Offset of the next allocation
+    size_t tail;        // Offset of the oldest entry not yet reclaimed
+    size_t used;        // Bytes between tail and head, padding included
+    size_t fallbacks;   // Allocations served by the general heap
+    pthread_mutex_t lock;
+} ring_allocator;
+
+int ring_init(ring_allocator* ring, size_t capacity);
+void ring_destroy(ring_allocator* ring);
+void* ring_alloc(ring_allocator* ring, size_t size);
+void ring_free(ring_allocator* ring, void* ptr);
+
+// Scratch (LIFO) allocator for temporaries. Each thread bump-allocates from
+// its own chain of chunks taken from the heap; scratch_release rolls the top
+// back to a marker in O(1), freeing everything allocated since the mark.
+// Chunks are kept for reuse until scratch_trim or thread exit.
+#define SCRATCH_CHUNK_SIZE 65536
+
+typedef struct scratch_chunk scratch_chunk;
+
+typedef struct scratch_marker {
+    scratch_chunk* chunk;   // Chunk that was current at the mark, NULL if none
+    size_t top;             // Its top at the mark
+} scratch_marker;
+
+scratch_marker scratch_mark(void);
+void* scratch_alloc(size_t size);
+void scratch_release(scratch_marker mark);
+void scratch_trim(void);
+
+// Region heaps: a self-contained heap inside one mapping. All metadata
+// lives in-band, starting with a region_heap header at offset 0, and every
+// link is an offset from that header, so the mapping can be reopened at a
+// different address. Used for file-backed persistent heaps and for heaps
+// shared between processes.
+#define REGION_MAGIC 0x5245474E48454150ULL  // "REGNHEAP"
+#define REGION_VERSION 2
+#define REGION_ROOT_COUNT 16
+
+typedef struct region_heap {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t clean;                       // Cleared while mapped, set on close
+    uint64_t size;                        // Bytes in the mapping
+    uint64_t free_head;                   // Offset of the first free block, 0 if none
+    uint64_t live_bytes;                  // Payload bytes currently allocated
+    uint64_t roots[REGION_ROOT_COUNT];    // Offsets of user roots, 0 if unset
+    pthread_mutex_t lock;
+} region_heap;
+
+int region_format(region_heap* heap, size_t size);
+void* region_alloc(region_heap* heap, size_t size);
+void region_free(region_heap* heap, void* ptr);
+int region_contains(const region_heap* heap, const void* ptr);
+int region_validate(region_heap* heap);
+size_t region_purge(region_heap* heap);
+
+// Offset <-> pointer translation; offset 0 is the null pointer
+uint64_t region_offset(const region_heap* heap, const void* ptr);
+void* region_pointer(const region_heap* heap, uint64_t offset);
+
+// Named entry points that survive a remap
+void region_set_root(region_heap* heap, unsigned int index, void* ptr);
+void* region_get_root(region_heap* heap, unsigned int index);
+
+// File-backed persistent heap: created at size bytes if the file is new,
+// reopened with its blocks, free list and roots intact otherwise
+region_heap* persistent_heap_open(const char* path, size_t size);
+int persistent_heap_sync(region_heap* heap);
+void persistent_heap_close(region_heap* heap);
+
+// Cross-process shared heap in POSIX shm or a memfd. The region lock is
+// process-shared and robust, and processes exchange region offsets rather
+// than pointers since each maps the segment at its own address.
+region_heap* shared_heap_create(const char* name, size_t size);
+int shared_heap_memfd(size_t size);
+region_heap* shared_heap_attach(const char* name);
+region_heap* shared_heap_attach_fd(int fd);
+void shared_heap_detach(region_heap* heap);
+int shared_heap_unlink(const char* name);
+
+// Compressed heaps: a heap over one reserved address range whose metadata
+// is 32 bits wide. Block sizes and free-list links are stored as offsets
+// from the heap header in COMPRESSED_UNIT steps, so a heap of up to
+// COMPRESSED_HEAP_MAX bytes gets by with a 16-byte block header (a region
+// block's is 40), and the links of a free block sit in its first payload
+// word, next to the size a first-fit hop reads anyway. Pages of the range
+// are only backed once touched. compressed_offset and compressed_pointer
+// let callers keep 32-bit references to their own objects too.
+#define COMPRESSED_UNIT 8
+#define COMPRESSED_HEAP_MAX ((uint64_t)UINT32_MAX * COMPRESSED_UNIT)
+
+typedef struct compressed_heap {
+    uint64_t size;              // Bytes in the reserved range
+    uint64_t live_bytes;        // Payload bytes currently allocated
+    uint32_t free_head;         // Unit offset of the first free block, 0 if none
+    uint32_t free_blocks;
+    pthread_mutex_t lock;
+} compressed_heap;
+
+compressed_heap* compressed_heap_create(size_t size);
+void compressed_heap_destroy(compressed_heap* heap);
+void* compressed_alloc(compressed_heap* heap, size_t size);
+void compressed_free(compressed_heap* heap, void* ptr);
+int compressed_validate(compressed_heap* heap);
+uint32_t compressed_offset(const compressed_heap* heap, const void* ptr);
+void* compressed_pointer(const compressed_heap* heap, uint32_t offset);
+
+// Heap statistics
+typedef struct heap_stats {
+    size_t heap_size;           // Bytes between heap_start and heap_end
+    size_t free_bytes;          // Payload bytes in free blocks
+    size_t free_blocks;
+    size_t largest_free;        // Largest free payload
+    size_t allocated_blocks;    // Blocks in use, cached ones included
+    size_t pressure_events;     // Times pressure relief ran
+    size_t limit_failures;      // Expansions refused by the hard limit
+    size_t mapped_bytes;        // Bytes in mapped large allocations
+    size_t merges;              // Adjacent free blocks merged
+    size_t coalesce_sweeps;     // Deferred-coalescing sweeps run
+    size_t quick_blocks;        // Blocks parked on quick lists
+    size_t parked_blocks;       // Blocks parked in the concurrent index
+} heap_stats;
+
+void get_heap_stats(heap_stats* stats);
+
+// Debugging
+int validate_heap(void);
+void print_heap_debug(void);
+void print_size_classes(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ALLOCATOR_H
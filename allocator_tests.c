@@ -5,6 +5,15 @@
 #include <time.h>
 #include <sys/time.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef THREAD_TEST
+#include <pthread.h>
+#endif
 #include "allocator.h"
 
 // Include your allocator implementation here
@@ -222,6 +231,1401 @@ int test_double_free() {
     TEST_PASS();
 }
 
+// Test 10: Compile-time size-class lookup
+int test_size_classes() {
+    for (size_t size = 1; size <= SMALL_SIZE_MAX; size++) {
+        unsigned int cls = size_to_class(size);
+        TEST_ASSERT(cls < SIZE_CLASS_COUNT, "Class index out of range");
+        TEST_ASSERT(size_class_sizes[cls] >= size, "Class too small for request");
+        TEST_ASSERT(cls == 0 || size_class_sizes[cls - 1] < size, "Request not in its tightest class");
+    }
+    TEST_ASSERT(size_class_sizes[SIZE_CLASS_COUNT - 1] == SMALL_SIZE_MAX, "Last class is not SMALL_SIZE_MAX");
+    
+    // Small requests are rounded up to their class, so a freed block can be
+    // reused by any request of the same class
+    void* ptr1 = my_malloc(100);
+    my_free(ptr1);
+    void* ptr2 = my_malloc(112);
+    TEST_ASSERT(ptr2 == ptr1, "Same-class block not reused");
+    my_free(ptr2);
+    
+    TEST_PASS();
+}
+
+// Test 11: Thread cache round trip
+int test_thread_cache() {
+    void* ptr1 = my_malloc_inline(40);
+    TEST_ASSERT(ptr1 != NULL, "Inline allocation failed");
+    my_free_inline(ptr1);
+    
+    // The block sits in the cache, still allocated from the heap's view
+    block_header* block = (block_header*)((char*)ptr1 - sizeof(block_header));
+    TEST_ASSERT(block->magic == MAGIC_CACHED, "Freed block not cached");
+    TEST_ASSERT(validate_heap(), "Cached block breaks heap validation");
+    
+    void* ptr2 = my_malloc_inline(48);
+    TEST_ASSERT(ptr2 == ptr1, "Cached block not reused by its class");
+    my_free(ptr2);
+    
+    // Flushing hands the block back to the shared heap
+    tcache_flush();
+    TEST_ASSERT(block->magic == MAGIC_FREE || block->magic == MAGIC_ALLOCATED,
+                "Flushed block still cached");
+    TEST_ASSERT(validate_heap(), "Heap invalid after flush");
+    
+    TEST_PASS();
+}
+
+// Test 12: Ring allocator reclaims in FIFO order and wraps around
+int test_ring_allocator() {
+    ring_allocator ring;
+    TEST_ASSERT(ring_init(&ring, 16384), "Failed to create ring");
+    
+    // Steady-state message flow wraps around many times within the buffer
+    void* queue[8];
+    int head = 0, tail = 0;
+    for (int i = 0; i < 2000; i++) {
+        if (head - tail == 8) {
+            ring_free(&ring, queue[tail++ % 8]);
+        }
+        size_t size = 100 + (i * 37) % 900;
+        char* msg = (char*)ring_alloc(&ring, size);
+        TEST_ASSERT(msg != NULL, "Ring allocation failed");
+        TEST_ASSERT(((uintptr_t)msg % 8) == 0, "Ring entry not aligned");
+        memset(msg, i, size);
+        queue[head++ % 8] = msg;
+    }
+    TEST_ASSERT(ring.fallbacks == 0, "Steady-state flow should fit in the ring");
+    while (tail < head) {
+        ring_free(&ring, queue[tail++ % 8]);
+    }
+    TEST_ASSERT(ring.used == 0, "Ring not empty after freeing everything");
+    
+    // A size that would wrap with the header added is not carved from the ring
+    TEST_ASSERT(ring_alloc(&ring, SIZE_MAX - 4) == NULL, "Wrapping size served");
+    TEST_ASSERT(ring.used == 0, "Wrapping size took ring space");
+    
+    ring_destroy(&ring);
+    TEST_PASS();
+}
+
+// Test 13: Out-of-order frees and heap fallback
+int test_ring_out_of_order() {
+    ring_allocator ring;
+    TEST_ASSERT(ring_init(&ring, 16384), "Failed to create ring");
+    
+    void* a = ring_alloc(&ring, 4000);
+    void* b = ring_alloc(&ring, 4000);
+    void* c = ring_alloc(&ring, 4000);
+    TEST_ASSERT(a && b && c, "Ring allocation failed");
+    
+    // Freeing b first leaves it pending until a is freed
+    ring_free(&ring, b);
+    size_t used_before = ring.used;
+    TEST_ASSERT(used_before > 8000, "Out-of-order free reclaimed too early");
+    ring_free(&ring, a);
+    TEST_ASSERT(ring.used < used_before - 8000, "Tail did not advance over freed entries");
+    
+    // The ring cannot hold this next to c, so it comes from the heap
+    void* big = ring_alloc(&ring, 12000);
+    TEST_ASSERT(big != NULL, "Fallback allocation failed");
+    TEST_ASSERT(ring.fallbacks == 1, "Oversized request not served by the heap");
+    ring_free(&ring, big);
+    ring_free(&ring, c);
+    TEST_ASSERT(validate_heap(), "Heap invalid after ring fallback");
+    
+    ring_destroy(&ring);
+    TEST_PASS();
+}
+
+// Test 14: Scratch allocations roll back to a marker
+int test_scratch_allocator() {
+    scratch_marker outer = scratch_mark();
+    
+    char* keep = (char*)scratch_alloc(64);
+    TEST_ASSERT(keep != NULL, "Scratch allocation failed");
+    memset(keep, 0x5A, 64);
+    
+    scratch_marker inner = scratch_mark();
+    char* temp1 = (char*)scratch_alloc(1000);
+    TEST_ASSERT(temp1 != NULL && temp1 >= keep + 64, "Scratch allocations not stacked");
+    TEST_ASSERT(((uintptr_t)temp1 % 8) == 0, "Scratch allocation not aligned");
+    
+    // Spill over into further chunks, including one bigger than a chunk
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT(scratch_alloc(4096) != NULL, "Scratch spill failed");
+    }
+    TEST_ASSERT(scratch_alloc(SCRATCH_CHUNK_SIZE * 2) != NULL, "Oversized scratch allocation failed");
+    TEST_ASSERT(scratch_alloc(SIZE_MAX) == NULL, "Wrapping scratch size allocated");
+    
+    // Rolling back reuses the same space
+    scratch_release(inner);
+    char* temp2 = (char*)scratch_alloc(1000);
+    TEST_ASSERT(temp2 == temp1, "Release did not roll back the top");
+    for (int i = 0; i < 64; i++) {
+        TEST_ASSERT(keep[i] == 0x5A, "Data below the marker was clobbered");
+    }
+    
+    // Growing the heap for a new chunk may run pressure relief, which trims
+    // the scratch chain; the chain just given back must not be freed twice
+    heap_stats stats;
+    get_heap_stats(&stats);
+    heap_set_limits(stats.heap_size + 1, 0);
+    TEST_ASSERT(scratch_alloc(stats.largest_free + (1 << 20)) != NULL, "Scratch growth under pressure failed");
+    heap_set_limits(0, 0);
+    TEST_ASSERT(validate_heap(), "Heap invalid after scratch growth under pressure");
+    
+    scratch_release(outer);
+    scratch_trim();
+    TEST_ASSERT(validate_heap(), "Heap invalid after scratch use");
+    
+    TEST_PASS();
+}
+
+// Node stored in a persistent heap; links are region offsets
+typedef struct persistent_node {
+    uint64_t next;
+    int value;
+} persistent_node;
+
+// Test 15: Persistent heap survives close and reopen
+int test_persistent_heap() {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/allocator_pheap_%d", (int)getpid());
+    unlink(path);
+    
+    region_heap* heap = persistent_heap_open(path, 1 << 20);
+    TEST_ASSERT(heap != NULL, "Failed to create persistent heap");
+    
+    // Build a list 0..99 and drop the odd values to leave holes
+    uint64_t head = 0;
+    for (int i = 99; i >= 0; i--) {
+        persistent_node* node = (persistent_node*)region_alloc(heap, sizeof(persistent_node));
+        TEST_ASSERT(node != NULL, "Region allocation failed");
+        node->value = i;
+        node->next = head;
+        head = region_offset(heap, node);
+    }
+    persistent_node* node = (persistent_node*)region_pointer(heap, head);
+    while (node && node->next) {
+        persistent_node* odd = (persistent_node*)region_pointer(heap, node->next);
+        node->next = odd->next;
+        region_free(heap, odd);
+        node = (persistent_node*)region_pointer(heap, node->next);
+    }
+    region_set_root(heap, 0, region_pointer(heap, head));
+    uint64_t live = heap->live_bytes;
+    TEST_ASSERT(region_validate(heap), "Region invalid before close");
+    persistent_heap_close(heap);
+    
+    // Reopen: the list, the root and the free space are all still there
+    heap = persistent_heap_open(path, 0);
+    TEST_ASSERT(heap != NULL, "Failed to reopen persistent heap");
+    TEST_ASSERT(heap->live_bytes == live, "Live bytes changed across reopen");
+    TEST_ASSERT(region_validate(heap), "Region invalid after reopen");
+    
+    int expected = 0;
+    node = (persistent_node*)region_get_root(heap, 0);
+    while (node) {
+        TEST_ASSERT(node->value == expected, "List corrupted across reopen");
+        expected += 2;
+        node = (persistent_node*)region_pointer(heap, node->next);
+    }
+    TEST_ASSERT(expected == 100, "List lost nodes across reopen");
+    
+    // Freed holes are reused after reopening
+    void* reuse = region_alloc(heap, sizeof(persistent_node));
+    TEST_ASSERT(reuse != NULL, "Allocation after reopen failed");
+    region_free(heap, reuse);
+    TEST_ASSERT(region_alloc(heap, SIZE_MAX) == NULL, "Wrapping size allocated");
+    
+    // Freeing a block again after it merged into its free neighbour is
+    // refused instead of growing the neighbour over the next live block
+    char* a = (char*)region_alloc(heap, 400);
+    char* b = (char*)region_alloc(heap, 400);
+    char* c = (char*)region_alloc(heap, 400);
+    TEST_ASSERT(a && b && c, "Region allocation failed");
+    region_free(heap, a);
+    region_free(heap, b);
+    region_free(heap, b);
+    TEST_ASSERT(region_validate(heap), "Region invalid after double free");
+    char* merged = (char*)region_alloc(heap, 800);
+    TEST_ASSERT(merged != NULL, "Merged block not reused");
+    TEST_ASSERT(merged + 800 <= c || merged >= c + 400, "Double free handed out a live block");
+    region_free(heap, merged);
+    region_free(heap, c);
+    TEST_ASSERT(region_validate(heap), "Region invalid after merging");
+    
+    persistent_heap_close(heap);
+    unlink(path);
+    TEST_PASS();
+}
+
+// Test 16: Processes share one heap and exchange offsets
+int test_shared_heap() {
+    int fd = shared_heap_memfd(1 << 20);
+    TEST_ASSERT(fd >= 0, "Failed to create memfd heap");
+    region_heap* heap = shared_heap_attach_fd(fd);
+    TEST_ASSERT(heap != NULL, "Failed to attach memfd heap");
+    
+    pid_t pid = fork();
+    TEST_ASSERT(pid >= 0, "fork failed");
+    if (pid == 0) {
+        // Child: attach on its own, publish a payload by offset, then die
+        // holding the lock to check that the lock is recovered
+        region_heap* child = shared_heap_attach_fd(fd);
+        char* payload = child ? (char*)region_alloc(child, 4096) : NULL;
+        if (!payload) _exit(1);
+        for (int i = 0; i < 4096; i++) {
+            payload[i] = (char)(i % 251);
+        }
+        region_set_root(child, 1, payload);
+        pthread_mutex_lock(&child->lock);
+        _exit(0);
+    }
+    
+    int status = 0;
+    waitpid(pid, &status, 0);
+    TEST_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Child failed");
+    
+    // Zero-copy: the parent reads the child's object in place
+    char* payload = (char*)region_get_root(heap, 1);
+    TEST_ASSERT(payload != NULL, "Root not published");
+    for (int i = 0; i < 4096; i++) {
+        TEST_ASSERT(payload[i] == (char)(i % 251), "Shared payload corrupted");
+    }
+    
+    // The dead child's lock is recovered on the next operation
+    region_free(heap, payload);
+    TEST_ASSERT(heap->live_bytes == 0, "Free after lock recovery failed");
+    TEST_ASSERT(region_validate(heap), "Shared region invalid");
+    
+    shared_heap_detach(heap);
+    close(fd);
+    
+    // Named POSIX shm segments work the same way
+    char name[64];
+    snprintf(name, sizeof(name), "/allocator_test_%d", (int)getpid());
+    region_heap* named = shared_heap_create(name, 1 << 16);
+    TEST_ASSERT(named != NULL, "Failed to create shm heap");
+    region_heap* other = shared_heap_attach(name);
+    TEST_ASSERT(other != NULL && other != named, "Failed to attach shm heap");
+    void* obj = region_alloc(named, 100);
+    region_set_root(named, 0, obj);
+    TEST_ASSERT(region_offset(other, region_get_root(other, 0)) == region_offset(named, obj),
+                "Offsets differ between mappings");
+    shared_heap_detach(other);
+    shared_heap_detach(named);
+    TEST_ASSERT(shared_heap_unlink(name), "Failed to unlink shm heap");
+    
+    TEST_PASS();
+}
+
+// Test 17: Compaction moves unpinned handles and keeps their contents
+int test_handle_compaction() {
+    mem_handle handles[64];
+    char* before[64];
+    tcache_flush();
+    
+    for (int i = 0; i < 64; i++) {
+        handles[i] = handle_alloc(200 + (i % 4) * 64);
+        TEST_ASSERT(handles[i] != 0, "Handle allocation failed");
+        char* ptr = (char*)handle_pin(handles[i]);
+        memset(ptr, i, 200);
+        handle_unpin(handles[i]);
+    }
+    
+    // Punch holes, then pin one survivor so it has to stay put
+    for (int i = 0; i < 64; i += 2) {
+        handle_free(handles[i]);
+        handles[i] = 0;
+    }
+    for (int i = 1; i < 64; i += 2) {
+        before[i] = (char*)handle_pin(handles[i]);
+        handle_unpin(handles[i]);
+    }
+    char* pinned = (char*)handle_pin(handles[33]);
+    
+    // Small budgets make compaction take several bounded steps
+    int steps = 1;
+    while (!compact_heap_step(512)) {
+        steps++;
+    }
+    TEST_ASSERT(steps > 1, "Compaction did not run incrementally");
+    TEST_ASSERT(validate_heap(), "Heap invalid after compaction");
+    
+    int moved = 0;
+    for (int i = 1; i < 64; i += 2) {
+        char* ptr = (char*)handle_pin(handles[i]);
+        TEST_ASSERT(ptr <= before[i], "Block moved away from heap_start");
+        moved += (ptr != before[i]);
+        for (int j = 0; j < 200; j++) {
+            TEST_ASSERT(ptr[j] == (char)i, "Handle contents corrupted by compaction");
+        }
+        handle_unpin(handles[i]);
+    }
+    TEST_ASSERT(moved > 0, "Compaction moved nothing");
+    TEST_ASSERT(handle_pin(handles[33]) == pinned, "Pinned block was moved");
+    handle_unpin(handles[33]);
+    handle_unpin(handles[33]);
+    
+    for (int i = 1; i < 64; i += 2) {
+        handle_free(handles[i]);
+    }
+    compact_heap();
+    TEST_ASSERT(validate_heap(), "Heap invalid after final compaction");
+    
+    TEST_PASS();
+}
+
+// Test 18: Lifetime hints place objects in separate arenas
+int test_lifetime_hints() {
+    void* shorts[100];
+    void* longs[10];
+    
+    for (int i = 0; i < 100; i++) {
+        shorts[i] = my_malloc_hint(64 + i, LIFETIME_SHORT);
+        TEST_ASSERT(shorts[i] != NULL, "Short-lived allocation failed");
+        TEST_ASSERT(lifetime_of(shorts[i]) == LIFETIME_SHORT, "Short-lived object misplaced");
+        if (i % 10 == 0) {
+            longs[i / 10] = my_malloc_hint(48, LIFETIME_LONG);
+            TEST_ASSERT(lifetime_of(longs[i / 10]) == LIFETIME_LONG, "Long-lived object misplaced");
+        }
+    }
+    void* forever = my_malloc_hint(256, LIFETIME_PERMANENT);
+    TEST_ASSERT(lifetime_of(forever) == LIFETIME_PERMANENT, "Permanent object misplaced");
+    
+    void* plain = my_malloc_hint(64, LIFETIME_DEFAULT);
+    TEST_ASSERT(lifetime_of(plain) == LIFETIME_DEFAULT, "Default hint left the main heap");
+    my_free(plain);
+    
+    // Long-lived objects pack next to each other despite the churn
+    for (int i = 1; i < 10; i++) {
+        TEST_ASSERT((char*)longs[i] - (char*)longs[i - 1] < 128, "Long-lived objects not packed");
+    }
+    
+    for (int i = 0; i < 100; i++) {
+        my_free(shorts[i]);
+    }
+    TEST_ASSERT(lifetime_live_bytes(LIFETIME_SHORT) == 0, "Short-lived arena not empty");
+    TEST_ASSERT(lifetime_live_bytes(LIFETIME_LONG) >= 10 * 48, "Long-lived objects lost");
+    
+    for (int i = 0; i < 10; i++) {
+        my_free(longs[i]);
+    }
+    my_free(forever);
+    TEST_ASSERT(lifetime_live_bytes(LIFETIME_LONG) == 0, "Long-lived arena not empty");
+    TEST_ASSERT(validate_heap(), "Heap invalid after hinted allocations");
+    
+    TEST_PASS();
+}
+
+// Call sites for the prediction test; noinline keeps their return
+// addresses distinct
+__attribute__((noinline)) void* churn_site(size_t size) {
+    return my_malloc(size);
+}
+
+__attribute__((noinline)) void* keeper_site(size_t size) {
+    return my_malloc(size);
+}
+
+// Test 19: Call sites that churn are learned and routed to the churn arena
+int test_site_prediction() {
+    static void* kept[1000];
+    site_prediction_enable(1);
+    
+    // Keepers live across thousands of churn allocations
+    for (int i = 0; i < 1000; i++) {
+        kept[i] = keeper_site(64);
+        TEST_ASSERT(kept[i] != NULL, "Keeper allocation failed");
+    }
+    
+    // The last churn allocation comes from the same call instruction after
+    // the site has been learned (sites can move when LTO inlines my_malloc)
+    void* churned = NULL;
+    for (int i = 0; i <= 8000; i++) {
+        churned = churn_site(64);
+        if (i < 8000) {
+            my_free(churned);
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        my_free(kept[i]);
+    }
+    TEST_ASSERT(lifetime_of(churned) == LIFETIME_SHORT, "Churn site not routed to the churn arena");
+    TEST_ASSERT(lifetime_of(kept[0]) == LIFETIME_DEFAULT, "Long-lived site misclassified");
+    my_free(churned);
+    
+    // Sites not predicted short keep the tiny-class routing of my_malloc
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 1), "Failed to enable tiny classes");
+    void* tiny = keeper_site(8);
+    TEST_ASSERT(tiny && is_slab_page_address(tiny), "Prediction bypassed the tiny classes");
+    my_free(tiny);
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 0), "Failed to disable tiny classes");
+    
+    print_site_predictions();
+    site_prediction_enable(0);
+    TEST_ASSERT(validate_heap(), "Heap invalid after prediction run");
+    
+    TEST_PASS();
+}
+
+// Limit callback for the tagging test
+int tag_callback_calls[2];
+
+void record_tag_limit(unsigned int tag, size_t live_bytes, size_t request, int hard) {
+    (void)tag;
+    (void)live_bytes;
+    (void)request;
+    tag_callback_calls[hard ? 1 : 0]++;
+}
+
+// Test 20: Tagged allocations are accounted and capped per tag
+int test_allocation_tags() {
+    enum { TAG_CACHE = 3, TAG_PARSER = 4, TAG_MAPPED = 5 };
+    tag_stats stats;
+    void* ptrs[20];
+    
+    // Scoped tag applies to plain my_malloc
+    unsigned int previous = alloc_tag_enter(TAG_PARSER);
+    for (int i = 0; i < 10; i++) {
+        ptrs[i] = my_malloc(100);
+    }
+    alloc_tag_leave(previous);
+    alloc_tag_stats(TAG_PARSER, &stats);
+    TEST_ASSERT(stats.allocs == 10 && stats.live_bytes >= 10 * 100, "Scoped tag not accounted");
+    
+    // Soft limit warns once, hard limit refuses
+    TEST_ASSERT(alloc_tag_set_limit(TAG_CACHE, 4096, 8192, record_tag_limit), "Failed to set limits");
+    int refused = 0;
+    for (int i = 10; i < 20; i++) {
+        ptrs[i] = my_malloc_tagged(1000, TAG_CACHE);
+        refused += (ptrs[i] == NULL);
+    }
+    alloc_tag_stats(TAG_CACHE, &stats);
+    TEST_ASSERT(tag_callback_calls[0] == 1, "Soft limit callback not invoked once");
+    TEST_ASSERT(refused > 0 && tag_callback_calls[1] == refused, "Hard limit not enforced");
+    TEST_ASSERT(stats.live_bytes <= 8192, "Tag exceeded its hard limit");
+    TEST_ASSERT(stats.failures == (uint64_t)refused, "Refusals not counted");
+    
+    for (int i = 0; i < 20; i++) {
+        my_free(ptrs[i]);
+    }
+    alloc_tag_stats(TAG_CACHE, &stats);
+    TEST_ASSERT(stats.live_bytes == 0, "Tag live bytes not released");
+    alloc_tag_stats(TAG_PARSER, &stats);
+    TEST_ASSERT(stats.live_bytes == 0 && stats.frees == 10, "Scoped tag frees not accounted");
+    
+    // The hard limit holds against the payload charged, here a mapping
+    // rounded up to pages past the size asked for
+    TEST_ASSERT(alloc_tag_set_limit(TAG_MAPPED, 0, 130 * 1024, record_tag_limit), "Failed to set limit");
+    TEST_ASSERT(my_mallopt(MALLOPT_MMAP_THRESHOLD, 128 * 1024), "Failed to set mmap threshold");
+    TEST_ASSERT(my_malloc_tagged(128 * 1024 + 1, TAG_MAPPED) == NULL, "Rounded payload passed the hard limit");
+    TEST_ASSERT(my_mallopt(MALLOPT_MMAP_THRESHOLD, 0), "Failed to clear mmap threshold");
+    alloc_tag_stats(TAG_MAPPED, &stats);
+    TEST_ASSERT(stats.live_bytes == 0 && stats.failures == 1, "Backed-out block still charged");
+    alloc_tag_set_limit(TAG_MAPPED, 0, 0, NULL);
+    
+    print_tag_stats();
+    alloc_tag_set_limit(TAG_CACHE, 0, 0, NULL);
+    TEST_ASSERT(validate_heap(), "Heap invalid after tagged allocations");
+    
+    TEST_PASS();
+}
+
+// Shrinker for the limits test: frees the blocks it was handed
+int shrinker_calls = 0;
+
+size_t release_held_blocks(size_t wanted, void* arg) {
+    void** held = (void**)arg;
+    size_t released = 0;
+    (void)wanted;
+    shrinker_calls++;
+    for (int i = 0; i < 8; i++) {
+        if (held[i]) {
+            my_free(held[i]);
+            held[i] = NULL;
+            released += 4000;
+        }
+    }
+    return released;
+}
+
+// Test 21: Heap growth honours soft and hard limits
+int test_heap_limits() {
+    void* held[8];
+    heap_stats before, after;
+    
+    for (int i = 0; i < 8; i++) {
+        held[i] = my_malloc(4000);
+        TEST_ASSERT(held[i] != NULL, "Allocation failed");
+    }
+    get_heap_stats(&before);
+    
+    // Crossing the soft limit runs the shrinkers before growing
+    heap_set_limits(before.heap_size, before.heap_size + 256 * 1024);
+    TEST_ASSERT(heap_add_shrinker(release_held_blocks, held), "Failed to add shrinker");
+    void* grown = my_malloc(before.largest_free + 1024);
+    get_heap_stats(&after);
+    TEST_ASSERT(grown != NULL, "Allocation under the hard limit failed");
+    TEST_ASSERT(shrinker_calls == 1 && held[0] == NULL, "Shrinker not invoked");
+    TEST_ASSERT(after.pressure_events == before.pressure_events + 1, "Pressure relief not counted");
+    
+    // Growth past the hard limit fails cleanly
+    TEST_ASSERT(my_malloc(512 * 1024) == NULL, "Hard limit not enforced");
+    get_heap_stats(&after);
+    TEST_ASSERT(after.limit_failures == before.limit_failures + 1, "Refusal not counted");
+    TEST_ASSERT(heap_remove_shrinker(release_held_blocks, held), "Failed to remove shrinker");
+    heap_set_limits(0, 0);
+    my_free(grown);
+    
+    // A cgroup reporting stalls above the threshold counts as pressure
+    char path[] = "/tmp/allocator_pressure_XXXXXX";
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "Failed to create pressure file");
+    const char* report = "some avg10=42.50 avg60=10.00 avg300=2.00 total=123456\n"
+                         "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    TEST_ASSERT(write(fd, report, strlen(report)) == (ssize_t)strlen(report), "Failed to write pressure file");
+    close(fd);
+    TEST_ASSERT(heap_watch_cgroup_pressure(path, 10.0), "Failed to watch pressure file");
+    get_heap_stats(&before);
+    grown = my_malloc(before.largest_free + 1024);
+    get_heap_stats(&after);
+    TEST_ASSERT(grown != NULL, "Allocation under cgroup pressure failed");
+    TEST_ASSERT(after.pressure_events == before.pressure_events + 1, "Cgroup pressure not noticed");
+    heap_watch_cgroup_pressure(path, 0.0);
+    unlink(path);
+    my_free(grown);
+    
+    TEST_ASSERT(validate_heap(), "Heap invalid after pressure relief");
+    
+    TEST_PASS();
+}
+
+// Buffer the fixed-heap child process runs its whole heap on
+char fixed_heap_buffer[64 * 1024];
+
+// Body of the fixed-heap test, run in a fresh process because the heap can
+// only be put on a buffer before its first allocation
+int run_fixed_heap_child(void) {
+    void* ptrs[1024];
+    size_t count = 0;
+    size_t in_buffer = 0;
+    
+    if (init_allocator_fixed(fixed_heap_buffer, sizeof(fixed_heap_buffer)) == NULL) return 1;
+    if (init_allocator_fixed(fixed_heap_buffer, sizeof(fixed_heap_buffer)) != NULL) return 2;
+    void* brk_before = sbrk(0);
+    
+    // Nothing is mapped on the side: lifetime hints come from the buffer and
+    // there are no slab pages
+    char* hinted = (char*)my_malloc_hint(64, LIFETIME_SHORT);
+    if (!hinted || hinted < fixed_heap_buffer || hinted >= fixed_heap_buffer + sizeof(fixed_heap_buffer)) return 8;
+    my_free(hinted);
+    if (slab_page_alloc() != NULL || my_malloc_lines(64) != NULL) return 9;
+    
+    // Fill the buffer, which is the whole capacity; exhaustion fails cleanly
+    // instead of growing
+    while (count < 1024 && (ptrs[count] = my_malloc(200)) != NULL) {
+        char* ptr = (char*)ptrs[count];
+        if (ptr >= fixed_heap_buffer && ptr + 200 <= fixed_heap_buffer + sizeof(fixed_heap_buffer)) {
+            in_buffer++;
+        }
+        memset(ptr, (int)count, 200);
+        count++;
+    }
+    if (in_buffer != count || count == 1024) return 4;
+    if (sbrk(0) != brk_before) return 5;
+    
+    // Everything comes back and coalesces into one large block
+    for (size_t i = 0; i < count; i++) {
+        my_free(ptrs[i]);
+    }
+    tcache_flush();
+    void* large = my_malloc(sizeof(fixed_heap_buffer) / 2);
+    if (large == NULL || sbrk(0) != brk_before) return 6;
+    my_free(large);
+    
+    return validate_heap() ? 0 : 7;
+}
+
+// Body of the bootstrap test: the first allocations of a fresh process
+// come from the static seed without moving the break
+int run_seed_heap_child(void) {
+    heap_stats stats;
+    void* brk_before = sbrk(0);
+    
+    void* small[16];
+    for (int i = 0; i < 16; i++) {
+        small[i] = my_malloc(64 + i * 16);
+        if (!small[i]) return 1;
+        memset(small[i], i, 64 + i * 16);
+    }
+    get_heap_stats(&stats);
+    if (sbrk(0) != brk_before || stats.heap_size != 0) return 2;
+    
+    // Outgrowing the seed sets up the sbrk heap on the expansion path
+    void* large = my_malloc(64 * 1024);
+    get_heap_stats(&stats);
+    if (!large || stats.heap_size == 0 || sbrk(0) == brk_before) return 3;
+    
+    // Seed blocks are freed and coalesced like any other
+    for (int i = 0; i < 16; i++) {
+        my_free(small[i]);
+    }
+    tcache_flush();
+    my_free(large);
+    return validate_heap() ? 0 : 4;
+}
+
+// Body of the MYALLOC_CONF test, run with the variable set
+int run_env_config_child(void) {
+    if (my_mallopt_get(MALLOPT_TCACHE_COUNT) != 3) return 1;
+    if (my_mallopt_get(MALLOPT_GROWTH_CHUNK) != 65536) return 2;
+    if (my_mallopt_get(MALLOPT_POLICY) != FIT_BEST) return 3;
+    return 0;
+}
+
+// Run this test binary again with flag and return its exit status
+int run_in_fresh_process(const char* flag) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        execl("/proc/self/exe", "allocator_test", flag, (char*)NULL);
+        _exit(127);
+    }
+    
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Test 22: Heap on a caller-provided buffer never calls sbrk
+int test_fixed_heap() {
+    TEST_ASSERT(run_in_fresh_process("--fixed-heap") == 0, "Fixed heap child failed");
+    
+    TEST_PASS();
+}
+
+// Test 23: First allocations are served from the static seed
+int test_seed_bootstrap() {
+    TEST_ASSERT(run_in_fresh_process("--seed-heap") == 0, "Seed heap child failed");
+    
+    TEST_PASS();
+}
+
+// Test 24: Tunables from my_mallopt and MYALLOC_CONF
+int test_runtime_config() {
+    heap_stats before, after;
+    
+    // Parsing applies valid pairs and reports bad ones
+    TEST_ASSERT(my_mallopt_parse("growth_chunk:8192,policy:best,tcache_count:8"), "Valid config rejected");
+    TEST_ASSERT(my_mallopt_get(MALLOPT_GROWTH_CHUNK) == 8192, "Growth chunk not applied");
+    TEST_ASSERT(my_mallopt_get(MALLOPT_POLICY) == FIT_BEST, "Policy not applied");
+    TEST_ASSERT(my_mallopt_get(MALLOPT_TCACHE_COUNT) == 8, "Cache count not applied");
+    TEST_ASSERT(!my_mallopt_parse("arena_max:0,no_such_key:1,split_threshold:x"), "Bad config accepted");
+    TEST_ASSERT(!my_mallopt(MALLOPT_MMAP_THRESHOLD, 64), "Small mmap threshold accepted");
+    
+    // Best fit still hands out usable memory
+    void* ptrs[32];
+    for (int i = 0; i < 32; i++) {
+        ptrs[i] = my_malloc(100 + i * 40);
+        TEST_ASSERT(ptrs[i] != NULL, "Best-fit allocation failed");
+    }
+    for (int i = 0; i < 32; i++) {
+        my_free(ptrs[i]);
+    }
+    
+    // Requests over the mmap threshold bypass the heap
+    TEST_ASSERT(my_mallopt(MALLOPT_MMAP_THRESHOLD, 128 * 1024), "Failed to set mmap threshold");
+    get_heap_stats(&before);
+    char* mapped = (char*)my_malloc(256 * 1024);
+    get_heap_stats(&after);
+    TEST_ASSERT(mapped != NULL, "Mapped allocation failed");
+    TEST_ASSERT(after.mapped_bytes >= before.mapped_bytes + 256 * 1024, "Large request not mapped");
+    TEST_ASSERT(after.heap_size == before.heap_size, "Mapped request grew the heap");
+    memset(mapped, 0x5A, 256 * 1024);
+    my_free(mapped);
+    get_heap_stats(&after);
+    TEST_ASSERT(after.mapped_bytes == before.mapped_bytes, "Mapping not released");
+    TEST_ASSERT(my_malloc(SIZE_MAX) == NULL, "Wrapping size mapped");
+    TEST_ASSERT(my_mallopt(MALLOPT_MMAP_THRESHOLD, 0), "Failed to clear mmap threshold");
+    TEST_ASSERT(my_malloc(SIZE_MAX - 4) == NULL, "Wrapping size served by the heap");
+    
+    // Freeing a large tail block trims it once over the trim threshold
+    TEST_ASSERT(my_mallopt(MALLOPT_TRIM_THRESHOLD, 32 * 1024), "Failed to set trim threshold");
+    get_heap_stats(&before);
+    void* tail = my_malloc(before.largest_free + 64 * 1024);
+    TEST_ASSERT(tail != NULL, "Tail allocation failed");
+    get_heap_stats(&before);
+    my_free(tail);
+    get_heap_stats(&after);
+    TEST_ASSERT(after.heap_size < before.heap_size, "Free tail not trimmed");
+    
+    // Restore the defaults
+    TEST_ASSERT(my_mallopt_parse("growth_chunk:4096,policy:first,tcache_count:32,trim_threshold:0"),
+                "Failed to restore defaults");
+    TEST_ASSERT(validate_heap(), "Heap invalid after tuning");
+    
+    // MYALLOC_CONF is applied before main
+    setenv("MYALLOC_CONF", "tcache_count:3,growth_chunk:0x10000,policy:best", 1);
+    int status = run_in_fresh_process("--env-config");
+    unsetenv("MYALLOC_CONF");
+    TEST_ASSERT(status == 0, "MYALLOC_CONF not applied");
+    
+    TEST_PASS();
+}
+
+// Allocate count blocks separated by live spacers, free the blocks in
+// reverse so a LIFO list holds them backwards, then allocate them again
+int refill_holes_ascending(int count) {
+    void* holes[64];
+    void* spacers[64];
+    void* again[64];
+    int ascending = 1;
+    
+    for (int i = 0; i < count; i++) {
+        holes[i] = my_malloc(96);
+        spacers[i] = my_malloc(96);
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        my_free(holes[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        again[i] = my_malloc(96);
+        if (i > 0 && again[i] < again[i - 1]) {
+            ascending = 0;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        my_free(again[i]);
+        my_free(spacers[i]);
+    }
+    return ascending;
+}
+
+// Test 25: Address-ordered free lists hand out ascending addresses
+int test_address_ordered_free_list() {
+    // Without the thread cache every free reaches the heap's list
+    TEST_ASSERT(my_mallopt(MALLOPT_TCACHE_COUNT, 0), "Failed to disable the cache");
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_FREE_ORDER, FREE_ORDER_ADDRESS), "Failed to set address order");
+    TEST_ASSERT(refill_holes_ascending(64), "Address order not kept on insert");
+    TEST_ASSERT(validate_heap(), "Heap invalid in address order");
+    
+    // Batch mode: LIFO until the list is sorted
+    TEST_ASSERT(my_mallopt(MALLOPT_FREE_ORDER, FREE_ORDER_SORTED), "Failed to set sorted order");
+    void* holes[64];
+    void* spacers[64];
+    for (int i = 0; i < 64; i++) {
+        holes[i] = my_malloc(96);
+        spacers[i] = my_malloc(96);
+    }
+    for (int i = 63; i >= 0; i--) {
+        my_free(holes[i]);
+    }
+    sort_free_list();
+    for (int i = 0; i < 64; i++) {
+        holes[i] = my_malloc(96);
+        TEST_ASSERT(i == 0 || holes[i] > holes[i - 1], "Sorted list not ascending");
+    }
+    for (int i = 0; i < 64; i++) {
+        my_free(holes[i]);
+        my_free(spacers[i]);
+    }
+    
+    TEST_ASSERT(my_mallopt_parse("free_order:lifo,tcache_count:32"), "Failed to restore defaults");
+    TEST_ASSERT(validate_heap(), "Heap invalid after sorting");
+    
+    TEST_PASS();
+}
+
+// Test 26: Deferred coalescing merges in sweeps instead of on free
+int test_deferred_coalescing() {
+    heap_stats before, after;
+    void* blocks[8];
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_TCACHE_COUNT, 0), "Failed to disable the cache");
+    TEST_ASSERT(my_mallopt(MALLOPT_COALESCE_DEFER, 1000000), "Failed to defer coalescing");
+    for (int i = 0; i < 8; i++) {
+        blocks[i] = my_malloc(200);
+        TEST_ASSERT(blocks[i] != NULL, "Allocation failed");
+    }
+    
+    // Frees leave the neighbours unmerged
+    get_heap_stats(&before);
+    for (int i = 0; i < 6; i++) {
+        my_free(blocks[i]);
+    }
+    get_heap_stats(&after);
+    TEST_ASSERT(after.merges == before.merges, "Free merged despite deferral");
+    
+    // Freed blocks are reused as they are
+    void* reused = my_malloc(200);
+    TEST_ASSERT(reused != NULL && validate_heap(), "Unmerged block not reusable");
+    my_free(reused);
+    
+    // Reaching the threshold sweeps once and merges the whole run
+    TEST_ASSERT(my_mallopt(MALLOPT_COALESCE_DEFER, 1), "Failed to lower the threshold");
+    my_free(blocks[6]);
+    get_heap_stats(&after);
+    TEST_ASSERT(after.coalesce_sweeps == before.coalesce_sweeps + 1, "Threshold did not sweep");
+    TEST_ASSERT(after.merges >= before.merges + 6, "Sweep did not merge the run");
+    
+    // The merged run serves a request none of its pieces could
+    void* merged = my_malloc(6 * 200);
+    TEST_ASSERT(merged == blocks[0], "Merged run not reused");
+    my_free(merged);
+    my_free(blocks[7]);
+    
+    TEST_ASSERT(my_mallopt_parse("coalesce_defer:0,tcache_count:32"), "Failed to restore defaults");
+    TEST_ASSERT(validate_heap(), "Heap invalid after deferred coalescing");
+    
+    TEST_PASS();
+}
+
+// Test 27: Exact-size quick lists skip splitting and merging
+int test_quick_lists() {
+    heap_stats before, after;
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_TCACHE_COUNT, 0), "Failed to disable the cache");
+    TEST_ASSERT(my_mallopt(MALLOPT_QUICK_COUNT, 16), "Failed to enable quick lists");
+    TEST_ASSERT(my_mallopt(MALLOPT_QUICK_SIZE, 3000), "Failed to add a quick size");
+    TEST_ASSERT(!my_mallopt(MALLOPT_QUICK_SIZE, 100), "Small quick size accepted");
+    
+    char* a = (char*)my_malloc(3000);
+    char* b = (char*)my_malloc(3000);
+    char* c = (char*)my_malloc(3000);
+    TEST_ASSERT(a && b && c, "Allocation failed");
+    
+    // Frees park the blocks; their neighbours see them as in use
+    get_heap_stats(&before);
+    my_free(a);
+    my_free(b);
+    get_heap_stats(&after);
+    TEST_ASSERT(after.quick_blocks == before.quick_blocks + 2, "Blocks not parked");
+    TEST_ASSERT(after.merges == before.merges, "Parked block merged");
+    
+    // The same size pops the most recently parked block
+    char* again = (char*)my_malloc(3000);
+    TEST_ASSERT(again == b, "Quick list not used");
+    my_free(again);
+    
+    // Size classes have quick lists too
+    void* small = my_malloc(96);
+    my_free(small);
+    TEST_ASSERT(my_malloc(96) == small, "Class quick list not used");
+    my_free(small);
+    TEST_ASSERT(validate_heap(), "Heap invalid with parked blocks");
+    
+    // Switching them off drains into the heap, where the run merges
+    my_free(c);
+    get_heap_stats(&before);
+    TEST_ASSERT(my_mallopt_parse("quick_count:0,quick_size:0,tcache_count:32"), "Failed to restore defaults");
+    get_heap_stats(&after);
+    TEST_ASSERT(after.quick_blocks == 0, "Quick lists not drained");
+    TEST_ASSERT(after.merges >= before.merges + 2, "Drained blocks not merged");
+    TEST_ASSERT(validate_heap(), "Heap invalid after draining");
+    
+    TEST_PASS();
+}
+
+// Test 28: Large requests are served from the packed size index
+int test_large_index() {
+    void* holes[64];
+    void* spacers[64];
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_LARGE_INDEX, 2048), "Failed to enable the index");
+    for (int i = 0; i < 64; i++) {
+        holes[i] = my_malloc(2048 + i * 64);
+        spacers[i] = my_malloc(64);
+        TEST_ASSERT(holes[i] && spacers[i], "Allocation failed");
+    }
+    for (int i = 0; i < 64; i++) {
+        my_free(holes[i]);
+    }
+    TEST_ASSERT(validate_heap(), "Index inconsistent after frees");
+    
+    // The scalar scan answers every query the way the AVX2 scan does: the
+    // same slot under first fit, a block of the same size under best fit
+    for (int policy = FIT_FIRST; policy <= FIT_BEST; policy++) {
+        TEST_ASSERT(my_mallopt(MALLOPT_POLICY, policy), "Failed to set the policy");
+        for (int i = 0; i < 72; i++) {
+            size_t query = 2048 + i * 64 - 8;
+            block_header* vector = large_index_find(query);
+            int use_avx2 = large_use_avx2;
+            large_use_avx2 = 0;
+            block_header* scalar = large_index_find(query);
+            large_use_avx2 = use_avx2;
+            if (policy == FIT_FIRST) {
+                TEST_ASSERT(scalar == vector, "Scalar first fit disagrees");
+            } else {
+                TEST_ASSERT(scalar && vector ? scalar->payload_size == vector->payload_size : scalar == vector,
+                            "Scalar best fit disagrees");
+            }
+        }
+    }
+    
+    // Best fit picks the exact hole out of the packed sizes
+    TEST_ASSERT(my_mallopt(MALLOPT_POLICY, FIT_BEST), "Failed to set best fit");
+    void* exact = my_malloc(2048 + 37 * 64);
+    TEST_ASSERT(exact == holes[37], "Best fit missed the exact hole");
+    
+    // First fit returns a hole that holds the request
+    TEST_ASSERT(my_mallopt(MALLOPT_POLICY, FIT_FIRST), "Failed to set first fit");
+    char* fit = (char*)my_malloc(2048 + 60 * 64);
+    TEST_ASSERT(fit != NULL, "First fit failed");
+    memset(fit, 0x3C, 2048 + 60 * 64);
+    TEST_ASSERT(validate_heap(), "Index inconsistent after allocation");
+    
+    my_free(exact);
+    my_free(fit);
+    for (int i = 0; i < 64; i++) {
+        my_free(spacers[i]);
+    }
+    TEST_ASSERT(validate_heap(), "Index inconsistent after merging");
+    TEST_ASSERT(my_mallopt(MALLOPT_LARGE_INDEX, 0), "Failed to disable the index");
+    
+    TEST_PASS();
+}
+
+// Test 29: Large frees are parked in the concurrent index and claimed best fit
+int test_concurrent_index() {
+    void* blocks[3];
+    void* spacers[3];
+    heap_stats stats;
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_CONCURRENT_INDEX, 4096), "Failed to enable the index");
+    TEST_ASSERT(!my_mallopt(MALLOPT_CONCURRENT_INDEX, 64), "Small classes must stay out of the index");
+    for (int i = 0; i < 3; i++) {
+        blocks[i] = my_malloc((size_t)8192 << i);
+        spacers[i] = my_malloc(64);
+        TEST_ASSERT(blocks[i] && spacers[i], "Allocation failed");
+    }
+    for (int i = 2; i >= 0; i--) {
+        my_free(blocks[i]);
+    }
+    get_heap_stats(&stats);
+    TEST_ASSERT(stats.parked_blocks == 3, "Large frees not parked");
+    TEST_ASSERT(validate_heap(), "Index inconsistent after parking");
+    
+    // The smallest block that fits is claimed, whatever the free order, and
+    // a leftover still above the minimum is parked again
+    char* fit = (char*)my_malloc(10000);
+    TEST_ASSERT(fit == blocks[1], "Claim missed the best fit");
+    memset(fit, 0x5A, 10000);
+    char* exact = (char*)my_malloc(8192);
+    TEST_ASSERT(exact == blocks[0], "Claim missed the exact fit");
+    get_heap_stats(&stats);
+    TEST_ASSERT(stats.parked_blocks == 2, "Claimed blocks still parked");
+    TEST_ASSERT(validate_heap(), "Heap inconsistent after claims");
+    
+    // Disabling hands the rest back to the heap
+    TEST_ASSERT(my_mallopt(MALLOPT_CONCURRENT_INDEX, 0), "Failed to disable the index");
+    get_heap_stats(&stats);
+    TEST_ASSERT(stats.parked_blocks == 0, "Parked blocks not drained");
+    my_free(fit);
+    my_free(exact);
+    for (int i = 0; i < 3; i++) {
+        my_free(spacers[i]);
+    }
+    TEST_ASSERT(validate_heap(), "Heap inconsistent after draining");
+    
+    TEST_PASS();
+}
+
+// Test 30: Tiny objects are packed back to back on slab pages
+int test_tiny_classes() {
+    const size_t sizes[TINY_CLASS_COUNT] = { 8, 12, 16, 24 };
+    const size_t aligns[TINY_CLASS_COUNT] = { 8, 4, 8, 8 };
+    char* objects[TINY_CLASS_COUNT][64];
+    tiny_stats stats;
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 1), "Failed to enable tiny classes");
+    for (int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        for (int i = 0; i < 64; i++) {
+            objects[cls][i] = (char*)my_malloc(sizes[cls]);
+            TEST_ASSERT(objects[cls][i] != NULL, "Tiny allocation failed");
+            TEST_ASSERT(is_slab_page_address(objects[cls][i]), "Tiny object not on a slab page");
+            memset(objects[cls][i], cls * 64 + i, sizes[cls]);
+        }
+        // No header: a fresh page hands out neighbouring slots
+        TEST_ASSERT(objects[cls][1] - objects[cls][0] == (ptrdiff_t)sizes[cls], "Tiny objects not packed");
+        TEST_ASSERT(((uintptr_t)objects[cls][0] % aligns[cls]) == 0, "Tiny object misaligned");
+        get_tiny_stats(cls, &stats);
+        TEST_ASSERT(stats.object_size == sizes[cls] && stats.objects >= 64, "Tiny stats wrong");
+    }
+    
+    // Requests round up to the next tiny size
+    char* odd = (char*)my_malloc(9);
+    TEST_ASSERT(is_slab_page_address(odd), "9 bytes not served as tiny");
+    my_free(odd);
+    
+    for (int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        for (int i = 0; i < 64; i++) {
+            for (size_t j = 0; j < sizes[cls]; j++) {
+                TEST_ASSERT((unsigned char)objects[cls][i][j] == (unsigned char)(cls * 64 + i), "Tiny object overwritten");
+            }
+        }
+    }
+    
+    // A freed slot is the lowest free one and is handed out next
+    char* first = objects[0][3];
+    my_free(first);
+    TEST_ASSERT(my_malloc(8) == first, "Freed tiny slot not reused");
+    
+    for (int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        for (int i = 0; i < 64; i++) {
+            my_free(objects[cls][i]);
+        }
+    }
+    TEST_ASSERT(validate_heap(), "Tiny pages inconsistent");
+    
+    // Only 25 bytes and up leave the tiny classes, and turning them off
+    // sends small requests back to the heap
+    char* small = (char*)my_malloc(25);
+    TEST_ASSERT(!is_slab_page_address(small), "25 bytes served as tiny");
+    my_free(small);
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 0), "Failed to disable tiny classes");
+    small = (char*)my_malloc(8);
+    TEST_ASSERT(!is_slab_page_address(small), "Tiny class used while off");
+    my_free(small);
+    
+    TEST_PASS();
+}
+
+// Test 31: A compressed heap packs 16-byte headers and 32-bit links
+int test_compressed_heap() {
+    // Ranges whose offsets would not fit in 32 bits are refused
+    TEST_ASSERT(compressed_heap_create((size_t)COMPRESSED_HEAP_MAX + 4096) == NULL,
+                "Oversized compressed heap accepted");
+    
+    compressed_heap* heap = compressed_heap_create(1 << 20);
+    TEST_ASSERT(heap != NULL, "Failed to create compressed heap");
+    
+    char* a = (char*)compressed_alloc(heap, 16);
+    char* b = (char*)compressed_alloc(heap, 16);
+    char* c = (char*)compressed_alloc(heap, 100);
+    TEST_ASSERT(a && b && c, "Compressed allocation failed");
+    TEST_ASSERT(b - a == 32, "Header is not 16 bytes");
+    TEST_ASSERT(((uintptr_t)c % COMPRESSED_UNIT) == 0, "Allocation not aligned");
+    memset(a, 'a', 16);
+    memset(b, 'b', 16);
+    memset(c, 'c', 100);
+    
+    // Pointers round-trip through 32-bit offsets
+    uint32_t offset = compressed_offset(heap, c);
+    TEST_ASSERT(offset != 0, "Offset of a live pointer is 0");
+    TEST_ASSERT(compressed_pointer(heap, offset) == c, "Offset does not round-trip");
+    TEST_ASSERT(compressed_pointer(heap, 0) == NULL, "Offset 0 is not NULL");
+    
+    // A freed block is reused, and neighbours merge back into one block
+    compressed_free(heap, a);
+    char* d = (char*)compressed_alloc(heap, 8);
+    TEST_ASSERT(d == a, "Freed block not reused");
+    TEST_ASSERT(b[0] == 'b' && b[15] == 'b' && c[99] == 'c', "Neighbouring data corrupted");
+    TEST_ASSERT(heap->live_bytes == 16 + 16 + 104, "Live bytes wrong");
+    TEST_ASSERT(compressed_validate(heap), "Compressed heap inconsistent");
+    
+    compressed_free(heap, b);
+    compressed_free(heap, d);
+    compressed_free(heap, c);
+    TEST_ASSERT(heap->free_blocks == 1, "Free blocks not merged");
+    TEST_ASSERT(heap->live_bytes == 0, "Live bytes not released");
+    
+    // Double free is caught and leaves the heap intact
+    compressed_free(heap, c);
+    TEST_ASSERT(compressed_validate(heap), "Compressed heap inconsistent after double free");
+    
+    compressed_heap_destroy(heap);
+    TEST_PASS();
+}
+
+// Test 32: Line objects own whole cache lines
+int test_line_classes() {
+    char* objects[100];
+    
+    // 8-byte requests still get a 64-byte line each, with no header on it
+    TEST_ASSERT(my_mallopt_get(MALLOPT_LINE_SIZE) == 64, "Default line size is not 64");
+    for (int i = 0; i < 100; i++) {
+        objects[i] = (char*)my_malloc_lines(8);
+        TEST_ASSERT(objects[i] != NULL, "Line allocation failed");
+        TEST_ASSERT(((uintptr_t)objects[i] % 64) == 0, "Object not line aligned");
+        TEST_ASSERT(is_slab_page_address(objects[i]), "Object not on a slab page");
+        memset(objects[i], i, 64);
+    }
+    for (int i = 1; i < 100; i++) {
+        TEST_ASSERT(objects[i] - objects[i - 1] >= 64 || objects[i - 1] - objects[i] >= 64,
+                    "Objects share a line");
+        TEST_ASSERT((unsigned char)objects[i - 1][63] == (unsigned char)(i - 1), "Line data corrupted");
+    }
+    
+    // Larger requests round up to whole lines
+    char* a = (char*)my_malloc_lines(65);
+    char* b = (char*)my_malloc_lines(65);
+    TEST_ASSERT(a && b && (b - a == 128 || a - b == 128), "65 bytes not given two lines");
+    TEST_ASSERT(my_malloc_lines(LINE_CLASS_LINES * 64 + 1) == NULL, "Oversized line request served");
+    
+    // Adjacent-line pairs
+    TEST_ASSERT(!my_mallopt(MALLOPT_LINE_SIZE, 96), "Line size of 96 accepted");
+    TEST_ASSERT(my_mallopt(MALLOPT_LINE_SIZE, 128), "Failed to set 128-byte lines");
+    char* wide = (char*)my_malloc_lines(8);
+    TEST_ASSERT(wide && ((uintptr_t)wide % 128) == 0, "Object not aligned to 128 bytes");
+    my_free(wide);
+    TEST_ASSERT(my_mallopt(MALLOPT_LINE_SIZE, 64), "Failed to restore 64-byte lines");
+    
+    for (int i = 0; i < 100; i++) {
+        my_free(objects[i]);
+    }
+    my_free(a);
+    my_free(b);
+    TEST_ASSERT(validate_heap(), "Line pages inconsistent");
+    
+    TEST_PASS();
+}
+
+#ifdef THREAD_TEST
+// Write to a detector-followed object from a second thread
+void* false_sharing_writer(void* arg) {
+    char* object = (char*)arg;
+    for (int i = 0; i < 64 * FALSE_SHARING_SAMPLE_INTERVAL; i++) {
+        object[i % 8] = (char)i;
+        false_sharing_note_write(object + i % 8);
+    }
+    return NULL;
+}
+#endif
+
+// Test 33: Sampled writes are mapped back to their allocations
+int test_false_sharing_detector() {
+    false_sharing_entry entries[8];
+    char* objects[8];
+    
+    // Tiny objects pack eight to a line, so two of these share one
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 1), "Failed to enable tiny classes");
+    false_sharing_enable(1);
+    for (int i = 0; i < 8; i++) {
+        objects[i] = (char*)my_malloc(8);
+        TEST_ASSERT(objects[i] != NULL, "Allocation failed");
+    }
+    false_sharing_enable(0);
+    char* a = NULL;
+    char* b = NULL;
+    for (int i = 1; i < 8 && !a; i++) {
+        if ((uintptr_t)objects[i] / FALSE_SHARING_LINE == (uintptr_t)objects[i - 1] / FALSE_SHARING_LINE) {
+            a = objects[i - 1];
+            b = objects[i];
+        }
+    }
+    TEST_ASSERT(a && b, "No two tiny objects share a line");
+    
+    // Writes from one thread are true sharing at most
+    false_sharing_resume();
+    for (int i = 0; i < 64 * FALSE_SHARING_SAMPLE_INTERVAL; i++) {
+        a[i % 8] = (char)i;
+        false_sharing_note_write(a + i % 8);
+        b[i % 8] = (char)i;
+        false_sharing_note_write(b + i % 8);
+    }
+    TEST_ASSERT(false_sharing_collect(entries, 8) == 0, "Single-threaded writes reported");
+    
+#ifdef THREAD_TEST
+    // A second thread writing b makes the line falsely shared
+    pthread_t writer;
+    pthread_create(&writer, NULL, false_sharing_writer, b);
+    pthread_join(writer, NULL);
+    size_t count = false_sharing_collect(entries, 8);
+    TEST_ASSERT(count == 2, "Falsely shared pair not reported");
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT(entries[i].object == a || entries[i].object == b, "Wrong object reported");
+        TEST_ASSERT(entries[i].neighbour == (entries[i].object == a ? b : a), "Wrong neighbour reported");
+        TEST_ASSERT(entries[i].site != NULL && entries[i].site == entries[i].neighbour_site,
+                    "Call site not recorded");
+        TEST_ASSERT(entries[i].writes >= 64, "Sampled writes not credited");
+    }
+    
+    // An object straddling two lines is followed on its last line too
+    char* spans[16];
+    char* x = NULL;
+    char* y = NULL;
+    for (int i = 0; i < 16; i++) {
+        spans[i] = (char*)my_malloc(24);
+        TEST_ASSERT(spans[i] != NULL, "Allocation failed");
+        if (!x && i > 0 && spans[i] == spans[i - 1] + 24 &&
+            (uintptr_t)spans[i - 1] / FALSE_SHARING_LINE != (uintptr_t)(spans[i - 1] + 23) / FALSE_SHARING_LINE) {
+            x = spans[i - 1];
+            y = spans[i];
+        }
+    }
+    TEST_ASSERT(x && y, "No tiny object straddles a line");
+    for (int i = 0; i < 64 * FALSE_SHARING_SAMPLE_INTERVAL; i++) {
+        x[23] = (char)i;
+        false_sharing_note_write(x + 23);
+    }
+    pthread_create(&writer, NULL, false_sharing_writer, y);
+    pthread_join(writer, NULL);
+    count = false_sharing_collect(entries, 8);
+    int straddler_reported = 0;
+    for (size_t i = 0; i < count; i++) {
+        straddler_reported |= entries[i].object == x && entries[i].neighbour == y;
+    }
+    TEST_ASSERT(straddler_reported, "Sharing on a straddling object's last line not reported");
+    for (int i = 0; i < 16; i++) {
+        my_free(spans[i]);
+    }
+#endif
+    false_sharing_enable(0);
+    
+    // Freed objects are no longer followed
+    for (int i = 0; i < 8; i++) {
+        my_free(objects[i]);
+    }
+    TEST_ASSERT(false_sharing_collect(entries, 8) == 0, "Freed objects still reported");
+    TEST_ASSERT(my_mallopt(MALLOPT_TINY_CLASSES, 0), "Failed to disable tiny classes");
+    
+    TEST_PASS();
+}
+
+// Fill pages of the 448-byte line class with count objects, recording
+// the page offset of the first object on each new page
+size_t fill_line_pages(char** objects, size_t count, size_t* offsets) {
+    uintptr_t current = 0;
+    size_t pages = 0;
+    for (size_t i = 0; i < count; i++) {
+        objects[i] = (char*)my_malloc_lines(448);
+        uintptr_t page = (uintptr_t)objects[i] & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+        if (objects[i] && page != current) {
+            current = page;
+            offsets[pages++] = (uintptr_t)objects[i] - page;
+        }
+    }
+    return pages;
+}
+
+// Test 34: New slab pages rotate the offset of their first object
+int test_slab_coloring() {
+    char* objects[180];
+    size_t offsets[180];
+    
+    // 36 seven-line objects fit a page with 192 bytes to spare: 4 colors
+    TEST_ASSERT(my_mallopt_get(MALLOPT_SLAB_COLORING) == 1, "Coloring not on by default");
+    size_t pages = fill_line_pages(objects, 108, offsets);
+    TEST_ASSERT(pages == 3, "Objects not spread over three pages");
+    TEST_ASSERT(offsets[1] == offsets[0] + SLAB_COLOR_STEP && offsets[2] == offsets[1] + SLAB_COLOR_STEP,
+                "Pages not colored");
+    for (size_t i = 0; i < 108; i++) {
+        TEST_ASSERT(((uintptr_t)objects[i] % 64) == 0, "Colored object not line aligned");
+    }
+    
+    // Without coloring every new page starts at the same offset
+    TEST_ASSERT(my_mallopt(MALLOPT_SLAB_COLORING, 0), "Failed to turn coloring off");
+    pages = fill_line_pages(objects + 108, 72, offsets);
+    TEST_ASSERT(pages == 2 && offsets[0] == offsets[1], "Uncolored pages differ");
+    TEST_ASSERT(my_mallopt(MALLOPT_SLAB_COLORING, 1), "Failed to turn coloring on");
+    
+    for (size_t i = 0; i < 180; i++) {
+        my_free(objects[i]);
+    }
+    TEST_ASSERT(validate_heap(), "Colored pages inconsistent");
+    
+    TEST_PASS();
+}
+
+#ifdef THREAD_TEST
+// Worker for the multi-threaded test: churn through small and large sizes
+void* thread_worker(void* arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    void* ptrs[64] = {0};
+    
+    for (int i = 0; i < 20000; i++) {
+        int slot = rand_r(&seed) % 64;
+        if (ptrs[slot]) {
+            my_free(ptrs[slot]);
+            ptrs[slot] = NULL;
+        } else {
+            size_t size = (rand_r(&seed) % 8 == 0) ? 2048 + rand_r(&seed) % 4096 : rand_r(&seed) % 512 + 1;
+            ptrs[slot] = my_malloc(size);
+            if (ptrs[slot]) {
+                memset(ptrs[slot], slot, size);
+            }
+        }
+    }
+    for (int i = 0; i < 64; i++) {
+        my_free(ptrs[i]);
+    }
+    return NULL;
+}
+
+// Test 35: Concurrent allocation from several threads
+int test_threads() {
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT(pthread_create(&threads[i], NULL, thread_worker, (void*)(uintptr_t)(i + 1)) == 0,
+                    "Failed to start thread");
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    TEST_ASSERT(validate_heap(), "Heap corruption after threaded run");
+    
+    TEST_PASS();
+}
+
+// Worker for the concurrent index test: each block is stamped with its
+// owner and checked before it is freed, so a block claimed twice shows up
+void* large_claim_worker(void* arg) {
+    unsigned int seed = (unsigned int)(uintptr_t)arg;
+    unsigned char stamp = (unsigned char)(uintptr_t)arg;
+    unsigned char* ptrs[16] = {0};
+    size_t sizes[16] = {0};
+    uintptr_t failures = 0;
+    
+    for (int i = 0; i < 5000; i++) {
+        int slot = rand_r(&seed) % 16;
+        if (ptrs[slot]) {
+            for (size_t j = 0; j < sizes[slot]; j += 512) {
+                failures += ptrs[slot][j] != stamp;
+            }
+            my_free(ptrs[slot]);
+            ptrs[slot] = NULL;
+        } else {
+            sizes[slot] = 4096 + rand_r(&seed) % 16384;
+            ptrs[slot] = (unsigned char*)my_malloc(sizes[slot]);
+            if (ptrs[slot]) {
+                memset(ptrs[slot], stamp, sizes[slot]);
+            }
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        my_free(ptrs[i]);
+    }
+    return (void*)failures;
+}
+
+// Test 36: Threads claim parked large blocks without handing out one twice
+int test_concurrent_large_claims() {
+    pthread_t threads[8];
+    
+    TEST_ASSERT(my_mallopt(MALLOPT_CONCURRENT_INDEX, 4096), "Failed to enable the index");
+    for (int i = 0; i < 8; i++) {
+        TEST_ASSERT(pthread_create(&threads[i], NULL, large_claim_worker, (void*)(uintptr_t)(i + 1)) == 0,
+                    "Failed to start thread");
+    }
+    uintptr_t failures = 0;
+    for (int i = 0; i < 8; i++) {
+        void* result;
+        pthread_join(threads[i], &result);
+        failures += (uintptr_t)result;
+    }
+    TEST_ASSERT(failures == 0, "A block was handed to two threads");
+    TEST_ASSERT(validate_heap(), "Heap corruption after concurrent claims");
+    TEST_ASSERT(my_mallopt(MALLOPT_CONCURRENT_INDEX, 0), "Failed to disable the index");
+    TEST_ASSERT(validate_heap(), "Heap corruption after draining");
+    
+    TEST_PASS();
+}
+#endif
+
 // Performance comparison test
 void performance_test() {
     printf("\n=== Performance Test ===\n");
@@ -241,6 +1645,18 @@ void performance_test() {
     
     long custom_time = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
     
+    // Test the header-inline fast path
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < iterations; i++) {
+        void* ptr = my_malloc_inline(rand() % 1000 + 1);
+        if (ptr) {
+            my_free_inline(ptr);
+        }
+    }
+    gettimeofday(&end, NULL);
+    
+    long inline_time = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+    
     // Test system allocator
     gettimeofday(&start, NULL);
     for (int i = 0; i < iterations; i++) {
@@ -254,12 +1670,512 @@ void performance_test() {
     long system_time = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
     
     printf("Custom allocator: %ld microseconds\n", custom_time);
+    printf("Custom allocator (inline): %ld microseconds\n", inline_time);
     printf("System allocator: %ld microseconds\n", system_time);
     printf("Ratio: %.2fx %s\n", 
            (double)custom_time / system_time,
            custom_time > system_time ? "slower" : "faster");
 }
 
+// Mixed workload: long-lived objects allocated between short-lived churn.
+// Returns how many bytes of address space the long-lived objects span.
+size_t mixed_lifetime_workload(int hinted, void** longs, int long_count) {
+    void* window[64] = {0};
+    unsigned int seed = 42;
+    
+    for (int i = 0; i < long_count; i++) {
+        for (int j = 0; j < 8; j++) {
+            int slot = rand_r(&seed) % 64;
+            my_free(window[slot]);
+            size_t size = 32 + rand_r(&seed) % 480;
+            window[slot] = hinted ? my_malloc_hint(size, LIFETIME_SHORT) : my_malloc(size);
+        }
+        longs[i] = hinted ? my_malloc_hint(48, LIFETIME_LONG) : my_malloc(48);
+    }
+    for (int i = 0; i < 64; i++) {
+        my_free(window[i]);
+    }
+    
+    char* low = (char*)longs[0];
+    char* high = (char*)longs[0];
+    for (int i = 1; i < long_count; i++) {
+        if ((char*)longs[i] < low) low = (char*)longs[i];
+        if ((char*)longs[i] > high) high = (char*)longs[i];
+    }
+    return (size_t)(high - low) + 48;
+}
+
+// Fragmentation benchmark: lifetime hints versus one shared heap
+void fragmentation_test() {
+    printf("\n=== Fragmentation Test ===\n");
+    
+    enum { LONG_COUNT = 2000 };
+    static void* longs[LONG_COUNT];
+    heap_stats stats;
+    size_t useful = LONG_COUNT * 48;
+    
+    size_t plain_span = mixed_lifetime_workload(0, longs, LONG_COUNT);
+    tcache_flush();
+    get_heap_stats(&stats);
+    printf("Unhinted: long-lived span %zu KiB (%.1f%% dense), %zu free holes left in the heap\n",
+           plain_span / 1024, 100.0 * useful / plain_span, stats.free_blocks);
+    for (int i = 0; i < LONG_COUNT; i++) {
+        my_free(longs[i]);
+    }
+    
+    size_t hinted_span = mixed_lifetime_workload(1, longs, LONG_COUNT);
+    printf("Hinted:   long-lived span %zu KiB (%.1f%% dense), short-lived live bytes %zu\n",
+           hinted_span / 1024, 100.0 * useful / hinted_span, lifetime_live_bytes(LIFETIME_SHORT));
+    for (int i = 0; i < LONG_COUNT; i++) {
+        my_free(longs[i]);
+    }
+}
+
+// Node of the list the locality benchmark walks
+typedef struct locality_node {
+    struct locality_node* next;
+    long value;
+} locality_node;
+
+// Punch holes between live spacers, freed in random order, then build a
+// list from nodes allocated into them. Returns the time to walk the list and
+// sets adjacent to the share of nodes placed right after their predecessor.
+long locality_workload(free_order order, int count, double* adjacent) {
+    void** spacers = (void**)malloc(count * sizeof(void*));
+    locality_node** nodes = (locality_node**)malloc(count * sizeof(locality_node*));
+    unsigned int seed = 7;
+    struct timeval start, end;
+    
+    my_mallopt(MALLOPT_FREE_ORDER, order);
+    for (int i = 0; i < count; i++) {
+        nodes[i] = (locality_node*)my_malloc(sizeof(locality_node) * 4);
+        spacers[i] = my_malloc(64);
+    }
+    for (int i = count - 1; i > 0; i--) {
+        int j = rand_r(&seed) % (i + 1);
+        locality_node* swap = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = swap;
+    }
+    for (int i = 0; i < count; i++) {
+        my_free(nodes[i]);
+    }
+    if (order == FREE_ORDER_SORTED) {
+        sort_free_list(); // Idle-time sort
+    }
+    
+    int near = 0;
+    for (int i = 0; i < count; i++) {
+        nodes[i] = (locality_node*)my_malloc(sizeof(locality_node) * 4);
+        nodes[i]->value = i;
+        nodes[i]->next = NULL;
+        if (i > 0) {
+            nodes[i - 1]->next = nodes[i];
+            long distance = (char*)nodes[i] - (char*)nodes[i - 1];
+            near += distance > 0 && distance <= 256;
+        }
+    }
+    *adjacent = 100.0 * near / (count - 1);
+    
+    long sum = 0;
+    gettimeofday(&start, NULL);
+    for (int pass = 0; pass < 50; pass++) {
+        for (locality_node* node = nodes[0]; node; node = node->next) {
+            sum += node->value;
+        }
+    }
+    gettimeofday(&end, NULL);
+    if (sum == 42) printf(" ");
+    
+    for (int i = 0; i < count; i++) {
+        my_free(nodes[i]);
+        my_free(spacers[i]);
+    }
+    free(nodes);
+    free(spacers);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Allocation locality benchmark: how free-list order places a batch of
+// consecutively allocated objects
+void locality_test() {
+    printf("\n=== Allocation Locality Test ===\n");
+    
+    const char* names[] = { "LIFO", "Address-ordered", "Batch-sorted" };
+    my_mallopt(MALLOPT_TCACHE_COUNT, 0);
+    for (int order = FREE_ORDER_LIFO; order <= FREE_ORDER_SORTED; order++) {
+        double adjacent = 0.0;
+        long walk = locality_workload((free_order)order, 4096, &adjacent);
+        printf("%-16s %5.1f%% of nodes follow their predecessor, list walk %ld microseconds\n",
+               names[order], adjacent, walk);
+    }
+    my_mallopt(MALLOPT_FREE_ORDER, FREE_ORDER_LIFO);
+    my_mallopt(MALLOPT_TCACHE_COUNT, TCACHE_COUNT_MAX);
+}
+
+// Coalescing benchmark: merge work and free latency with merging on every
+// free versus deferred to sweeps
+void coalescing_test() {
+    printf("\n=== Coalescing Test ===\n");
+    
+    enum { COUNT = 4000 };
+    void** ptrs = (void**)malloc(COUNT * sizeof(void*));
+    const size_t modes[] = { 0, 1024 };
+    unsigned int seed = 11;
+    struct timeval start, end;
+    heap_stats before, after;
+    
+    my_mallopt(MALLOPT_TCACHE_COUNT, 0);
+    for (int mode = 0; mode < 2; mode++) {
+        my_mallopt(MALLOPT_COALESCE_DEFER, modes[mode]);
+        get_heap_stats(&before);
+        
+        // Free-then-reallocate churn of similar sizes
+        for (int i = 0; i < COUNT; i++) {
+            ptrs[i] = my_malloc(64 + rand_r(&seed) % 448);
+        }
+        long free_time = 0;
+        for (int round = 0; round < 4; round++) {
+            gettimeofday(&start, NULL);
+            for (int i = round % 2; i < COUNT; i += 2) {
+                my_free(ptrs[i]);
+            }
+            gettimeofday(&end, NULL);
+            free_time += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+            for (int i = round % 2; i < COUNT; i += 2) {
+                ptrs[i] = my_malloc(64 + rand_r(&seed) % 448);
+            }
+        }
+        for (int i = 0; i < COUNT; i++) {
+            my_free(ptrs[i]);
+        }
+        
+        get_heap_stats(&after);
+        printf("%-9s %6zu merges, %4zu sweeps, %.0f ns per free\n",
+               modes[mode] ? "Deferred:" : "On free:",
+               after.merges - before.merges, after.coalesce_sweeps - before.coalesce_sweeps,
+               1000.0 * free_time / (4 * COUNT / 2));
+    }
+    my_mallopt(MALLOPT_COALESCE_DEFER, 0);
+    my_mallopt(MALLOPT_TCACHE_COUNT, TCACHE_COUNT_MAX);
+    free(ptrs);
+}
+
+// Time allocate_count allocations of a size only a few of hole_count free
+// holes can hold, with the large index at index_min (0 walks the list)
+long large_search_workload(size_t index_min, int hole_count, int allocate_count) {
+    void** holes = (void**)malloc(hole_count * sizeof(void*));
+    void** spacers = (void**)malloc(hole_count * sizeof(void*));
+    void** taken = (void**)malloc(allocate_count * sizeof(void*));
+    unsigned int seed = 5;
+    struct timeval start, end;
+    
+    my_mallopt(MALLOPT_LARGE_INDEX, index_min);
+    for (int i = 0; i < hole_count; i++) {
+        holes[i] = my_malloc(2048 + rand_r(&seed) % 4096);
+        spacers[i] = my_malloc(64);
+    }
+    for (int i = 0; i < hole_count; i++) {
+        my_free(holes[i]);
+    }
+    
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < allocate_count; i++) {
+        taken[i] = my_malloc(6000);
+    }
+    gettimeofday(&end, NULL);
+    
+    for (int i = 0; i < allocate_count; i++) {
+        my_free(taken[i]);
+    }
+    for (int i = 0; i < hole_count; i++) {
+        my_free(spacers[i]);
+    }
+    my_mallopt(MALLOPT_LARGE_INDEX, 0);
+    free(holes);
+    free(spacers);
+    free(taken);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Large-block search benchmark: free-list walk versus the packed index
+void large_search_test() {
+    printf("\n=== Large Block Search Test ===\n");
+    
+    // Deferred merging keeps the O(n) coalescing walk out of the timing
+    my_mallopt(MALLOPT_COALESCE_DEFER, 1 << 20);
+    for (int policy = FIT_FIRST; policy <= FIT_BEST; policy++) {
+        my_mallopt(MALLOPT_POLICY, policy);
+        long list_time = large_search_workload(0, 4000, 100);
+        long index_time = large_search_workload(1024, 4000, 100);
+        printf("%s fit over 4000 free blocks: list %ld microseconds, index %ld microseconds\n",
+               policy == FIT_FIRST ? "First" : "Best", list_time, index_time);
+    }
+    my_mallopt(MALLOPT_POLICY, FIT_FIRST);
+    my_mallopt(MALLOPT_COALESCE_DEFER, 0);
+}
+
+// Time a first-fit miss over count small free blocks on a region heap
+// (compressed 0) or a compressed heap. Each probe asks for the whole heap,
+// which no block can hold, so it walks every hole and the tail and fails.
+// The spacing between neighbouring objects goes to *stride.
+long compressed_walk_workload(int compressed, int count, int probes, size_t* stride) {
+    size_t size = (size_t)count * 128 + (1 << 20);
+    region_heap* region = NULL;
+    compressed_heap* packed = NULL;
+    void** ptrs = (void**)my_malloc(count * sizeof(void*));
+    struct timeval start, end;
+    
+    if (compressed) {
+        packed = compressed_heap_create(size);
+    } else {
+        region = (region_heap*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        region_format(region, size);
+    }
+    
+    // Free every other block so the holes cannot merge
+    for (int i = 0; i < count; i++) {
+        ptrs[i] = compressed ? compressed_alloc(packed, 16) : region_alloc(region, 16);
+    }
+    *stride = (size_t)((char*)ptrs[1] - (char*)ptrs[0]);
+    for (int i = 0; i < count; i += 2) {
+        if (compressed) compressed_free(packed, ptrs[i]);
+        else region_free(region, ptrs[i]);
+    }
+    
+    int misses = 0;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < probes; i++) {
+        void* ptr = compressed ? compressed_alloc(packed, size) : region_alloc(region, size);
+        misses += ptr == NULL;
+    }
+    gettimeofday(&end, NULL);
+    if (misses != probes) {
+        printf("Warning: %d of %d probes found a block\n", probes - misses, probes);
+    }
+    
+    if (compressed) {
+        compressed_heap_destroy(packed);
+    } else {
+        munmap(region, size);
+    }
+    my_free(ptrs);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Free-list walk over 16-byte objects: 64-bit versus compressed metadata
+void compressed_heap_test() {
+    printf("\n=== Compressed Heap Test ===\n");
+    
+    size_t region_stride, compressed_stride;
+    long region_time = compressed_walk_workload(0, 40000, 200, &region_stride);
+    long compressed_time = compressed_walk_workload(1, 40000, 200, &compressed_stride);
+    printf("16-byte object footprint: region %zu bytes, compressed %zu bytes\n",
+           region_stride, compressed_stride);
+    printf("First-fit miss over 20000 free blocks: region %ld microseconds, compressed %ld microseconds\n",
+           region_time, compressed_time);
+}
+
+// Open a counter of this thread's L1 data-cache read misses, -1 where
+// perf events are unavailable
+int l1_miss_counter_open(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Read the first object of each of 48 pages of 512-byte line objects over
+// and over, with new pages colored or not. Returns the time taken; the L1
+// misses counted go to *misses, -1 without hardware counters.
+long coloring_workload(int colored, long long* misses) {
+    enum { PAGES = 48, PER_PAGE = 31, ROUNDS = 20000 };
+    char* objects[PAGES * PER_PAGE];
+    volatile uint64_t* firsts[PAGES];
+    uintptr_t current = 0;
+    int pages = 0;
+    struct timeval start, end;
+    
+    my_mallopt(MALLOPT_SLAB_COLORING, colored);
+    for (int i = 0; i < PAGES * PER_PAGE; i++) {
+        objects[i] = (char*)my_malloc_lines(512);
+        // Out of slab pages: time the pages we have
+        if (!objects[i]) continue;
+        memset(objects[i], 0, 512);
+        uintptr_t page = (uintptr_t)objects[i] & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+        if (page != current && pages < PAGES) {
+            current = page;
+            firsts[pages++] = (volatile uint64_t*)objects[i];
+        }
+    }
+    
+    int fd = l1_miss_counter_open();
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    gettimeofday(&start, NULL);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int p = 0; p < pages; p++) {
+            (void)*firsts[p];
+        }
+    }
+    gettimeofday(&end, NULL);
+    *misses = -1;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, misses, sizeof(*misses)) != (ssize_t)sizeof(*misses)) {
+            *misses = -1;
+        }
+        close(fd);
+    }
+    
+    for (int i = 0; i < PAGES * PER_PAGE; i++) {
+        my_free(objects[i]);
+    }
+    my_mallopt(MALLOPT_SLAB_COLORING, 1);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Hot first objects of many slab pages: all at one offset versus colored
+void slab_coloring_test() {
+    printf("\n=== Slab Coloring Test ===\n");
+    
+    long long plain_misses, colored_misses;
+    long plain_time = coloring_workload(0, &plain_misses);
+    long colored_time = coloring_workload(1, &colored_misses);
+    printf("First objects of 48 pages x 20000 rounds: uncolored %ld microseconds, colored %ld microseconds\n",
+           plain_time, colored_time);
+    if (plain_misses >= 0 && colored_misses >= 0) {
+        printf("L1 data read misses: uncolored %lld, colored %lld\n", plain_misses, colored_misses);
+    } else {
+        printf("L1 data read misses: hardware counters unavailable\n");
+    }
+}
+
+#ifdef THREAD_TEST
+// Time eight threads churning large buffers with the concurrent index at
+// index_min (0 sends every large request through the heap lock)
+long large_contention_workload(size_t index_min) {
+    pthread_t threads[8];
+    struct timeval start, end;
+    
+    my_mallopt(MALLOPT_CONCURRENT_INDEX, index_min);
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < 8; i++) {
+        pthread_create(&threads[i], NULL, large_claim_worker, (void*)(uintptr_t)(i + 1));
+    }
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    gettimeofday(&end, NULL);
+    my_mallopt(MALLOPT_CONCURRENT_INDEX, 0);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Bump one counter from its own thread
+void* counter_worker(void* arg) {
+    uint64_t* counter = (uint64_t*)arg;
+    for (int i = 0; i < 5000000; i++) {
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+        false_sharing_note_write(counter);
+    }
+    return NULL;
+}
+
+// Time four threads each bumping its own counter
+long counter_run(uint64_t** counters) {
+    pthread_t threads[4];
+    struct timeval start, end;
+    
+    for (int i = 0; i < 4; i++) {
+        *counters[i] = 0;
+    }
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, counter_worker, counters[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+}
+
+// Time the counter run with the counters packed into one line-aligned
+// allocation, so all four share a line, or given a line each by
+// my_malloc_lines
+long false_sharing_workload(int lines) {
+    uint64_t* counters[4];
+    uint64_t* packed = NULL;
+    
+    if (!lines) {
+        packed = (uint64_t*)my_malloc_lines(4 * sizeof(uint64_t));
+    }
+    for (int i = 0; i < 4; i++) {
+        counters[i] = lines ? (uint64_t*)my_malloc_lines(sizeof(uint64_t)) : packed + i;
+    }
+    long time = counter_run(counters);
+    if (lines) {
+        for (int i = 0; i < 4; i++) {
+            my_free(counters[i]);
+        }
+    } else {
+        my_free(packed);
+    }
+    return time;
+}
+
+// Run the counters under the false-sharing detector and print its report.
+// Tiny classes pack the 8-byte counters into one line for it to find.
+void false_sharing_detect_counters() {
+    uint64_t* counters[4];
+    
+    my_mallopt(MALLOPT_TINY_CLASSES, 1);
+    false_sharing_enable(1);
+    for (int i = 0; i < 4; i++) {
+        counters[i] = (uint64_t*)my_malloc(sizeof(uint64_t));
+    }
+    counter_run(counters);
+    false_sharing_enable(0);
+    print_false_sharing();
+    for (int i = 0; i < 4; i++) {
+        my_free(counters[i]);
+    }
+    my_mallopt(MALLOPT_TINY_CLASSES, 0);
+}
+
+// Per-thread counters: one shared cache line versus one line each
+void false_sharing_test() {
+    printf("\n=== False Sharing Test ===\n");
+    
+    long packed_time = false_sharing_workload(0);
+    long line_time = false_sharing_workload(1);
+    printf("4 threads x 5000000 increments: packed %ld microseconds, line-aligned %ld microseconds\n",
+           packed_time, line_time);
+    
+    printf("Detector over counters packed in a tiny class:\n");
+    false_sharing_detect_counters();
+}
+
+// Many-threaded large-buffer benchmark: heap lock versus concurrent index
+void large_contention_test() {
+    printf("\n=== Large Block Contention Test ===\n");
+    
+    long locked_time = large_contention_workload(0);
+    long index_time = large_contention_workload(4096);
+    printf("8 threads churning 4-20 KiB buffers: heap lock %ld microseconds, concurrent index %ld microseconds\n",
+           locked_time, index_time);
+}
+#endif
+
 // Memory usage analysis
 void memory_usage_test() {
     printf("\n=== Memory Usage Analysis ===\n");
@@ -287,6 +2203,24 @@ void memory_usage_test() {
     
     print_heap_debug();
     
+    // Graph-sized nodes in the tiny classes
+    printf("Allocating 10000 objects of each tiny size...\n");
+    static void* tiny[TINY_CLASS_COUNT][10000];
+    const size_t tiny_request[TINY_CLASS_COUNT] = { 8, 12, 16, 24 };
+    my_mallopt(MALLOPT_TINY_CLASSES, 1);
+    for (int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        for (int i = 0; i < 10000; i++) {
+            tiny[cls][i] = my_malloc(tiny_request[cls]);
+        }
+    }
+    print_tiny_stats();
+    for (int cls = 0; cls < TINY_CLASS_COUNT; cls++) {
+        for (int i = 0; i < 10000; i++) {
+            my_free(tiny[cls][i]);
+        }
+    }
+    my_mallopt(MALLOPT_TINY_CLASSES, 0);
+    
     // Cleanup
     my_free(ptrs[0]);
     my_free(ptrs[2]);
@@ -295,7 +2229,17 @@ void memory_usage_test() {
 }
 
 // Main test runner
-int main() {
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "--fixed-heap") == 0) {
+        return run_fixed_heap_child();
+    }
+    if (argc > 1 && strcmp(argv[1], "--seed-heap") == 0) {
+        return run_seed_heap_child();
+    }
+    if (argc > 1 && strcmp(argv[1], "--env-config") == 0) {
+        return run_env_config_child();
+    }
+    
     printf("=== Custom Memory Allocator Test Suite ===\n\n");
     
     // Run all tests
@@ -308,6 +2252,35 @@ int main() {
     RUN_TEST(test_alignment);
     RUN_TEST(test_double_free);
     RUN_TEST(test_stress);
+    RUN_TEST(test_size_classes);
+    RUN_TEST(test_thread_cache);
+    RUN_TEST(test_ring_allocator);
+    RUN_TEST(test_ring_out_of_order);
+    RUN_TEST(test_scratch_allocator);
+    RUN_TEST(test_persistent_heap);
+    RUN_TEST(test_shared_heap);
+    RUN_TEST(test_handle_compaction);
+    RUN_TEST(test_lifetime_hints);
+    RUN_TEST(test_site_prediction);
+    RUN_TEST(test_allocation_tags);
+    RUN_TEST(test_heap_limits);
+    RUN_TEST(test_fixed_heap);
+    RUN_TEST(test_seed_bootstrap);
+    RUN_TEST(test_runtime_config);
+    RUN_TEST(test_address_ordered_free_list);
+    RUN_TEST(test_deferred_coalescing);
+    RUN_TEST(test_quick_lists);
+    RUN_TEST(test_large_index);
+    RUN_TEST(test_concurrent_index);
+    RUN_TEST(test_tiny_classes);
+    RUN_TEST(test_compressed_heap);
+    RUN_TEST(test_line_classes);
+    RUN_TEST(test_false_sharing_detector);
+    RUN_TEST(test_slab_coloring);
+#ifdef THREAD_TEST
+    RUN_TEST(test_threads);
+    RUN_TEST(test_concurrent_large_claims);
+#endif
     
     // Results
     printf("\n=== Test Results ===\n");
@@ -321,6 +2294,16 @@ int main() {
     
     // Additional analysis
     performance_test();
+    fragmentation_test();
+    locality_test();
+    coalescing_test();
+    large_search_test();
+    compressed_heap_test();
+    slab_coloring_test();
+#ifdef THREAD_TEST
+    large_contention_test();
+    false_sharing_test();
+#endif
     memory_usage_test();
     
     printf("\nFinal heap validation: %s\n", 
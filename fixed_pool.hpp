@@ -0,0 +1,138 @@
+#ifndef FIXED_POOL_HPP
+#define FIXED_POOL_HPP
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "allocator.h"
+
+// Fixed-size object pools for C++ code, backed by the allocator's slab pages.
+// Everything about the size class (stride, alignment, objects per slab, offset
+// of the first object) is computed at compile time, so allocate() and
+// deallocate() are a free-list pop and push with no size arithmetic.
+
+namespace pool_detail {
+
+constexpr std::size_t round_up(std::size_t value, std::size_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+constexpr bool is_power_of_two(std::size_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+constexpr std::size_t max_size(std::size_t a, std::size_t b) {
+    return a > b ? a : b;
+}
+
+} // namespace pool_detail
+
+template <std::size_t Size, std::size_t Align = alignof(std::max_align_t)>
+class FixedPool {
+    static_assert(Size > 0, "FixedPool needs a non-zero object size");
+    static_assert(pool_detail::is_power_of_two(Align), "Alignment must be a power of two");
+
+public:
+    // Slab geometry, all compile-time constants
+    static constexpr std::size_t alignment = pool_detail::max_size(Align, alignof(void*));
+    static constexpr std::size_t stride =
+        pool_detail::round_up(pool_detail::max_size(Size, sizeof(void*)), alignment);
+    static constexpr std::size_t first_offset = pool_detail::round_up(sizeof(slab_header), alignment);
+    static constexpr std::size_t objects_per_slab =
+        first_offset < SLAB_PAGE_SIZE ? (SLAB_PAGE_SIZE - first_offset) / stride : 0;
+    // Slab coloring: each new slab shifts its objects by the next of colors
+    // steps, using the room left past the last object
+    static constexpr std::size_t color_step = pool_detail::max_size(alignment, SLAB_COLOR_STEP);
+    static constexpr std::size_t colors =
+        objects_per_slab > 0 ? (SLAB_PAGE_SIZE - first_offset - objects_per_slab * stride) / color_step + 1 : 1;
+
+    static_assert(alignment <= SLAB_PAGE_SIZE, "Alignment larger than a slab page");
+    static_assert(objects_per_slab > 0, "Object does not fit in a slab page");
+
+    FixedPool() noexcept : free_(nullptr), slabs_(nullptr), next_color_(0) {}
+    FixedPool(const FixedPool&) = delete;
+    FixedPool& operator=(const FixedPool&) = delete;
+
+    ~FixedPool() {
+        while (slabs_) {
+            slab_header* next = slabs_->next;
+            slab_page_free(slabs_);
+            slabs_ = next;
+        }
+    }
+
+    // Pop an object; only an empty free list leaves the inline path
+    void* allocate() {
+        node* head = free_;
+        if (__builtin_expect(head != nullptr, 1)) {
+            free_ = head->next;
+            return head;
+        }
+        return refill();
+    }
+
+    // Push an object back; it must have come from this pool
+    void deallocate(void* ptr) noexcept {
+        node* n = static_cast<node*>(ptr);
+        n->next = free_;
+        free_ = n;
+    }
+
+private:
+    struct node {
+        node* next;
+    };
+
+    // Carve a fresh slab page into objects_per_slab objects
+    __attribute__((noinline)) void* refill() {
+        slab_header* page = static_cast<slab_header*>(slab_page_alloc());
+        if (!page) {
+            return nullptr;
+        }
+        page->owner = this;
+        page->object_size = static_cast<uint32_t>(stride);
+        page->next = slabs_;
+        slabs_ = page;
+
+        char* base = reinterpret_cast<char*>(page) + first_offset + next_color_ * color_step;
+        next_color_ = (next_color_ + 1) % colors;
+        // Object 0 is returned, the rest are threaded onto the free list
+        for (std::size_t i = objects_per_slab - 1; i > 0; i--) {
+            node* n = reinterpret_cast<node*>(base + i * stride);
+            n->next = free_;
+            free_ = n;
+        }
+        return base;
+    }
+
+    node* free_;
+    slab_header* slabs_;
+    std::size_t next_color_;
+};
+
+// Typed pool: the size class is picked from sizeof(T) and alignof(T)
+template <typename T>
+class ObjectPool {
+public:
+    template <typename... Args>
+    T* create(Args&&... args) {
+        void* mem = pool_.allocate();
+        if (!mem) {
+            return nullptr;
+        }
+        return new (mem) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* object) noexcept {
+        if (!object) return;
+        object->~T();
+        pool_.deallocate(object);
+    }
+
+    static constexpr std::size_t objects_per_slab = FixedPool<sizeof(T), alignof(T)>::objects_per_slab;
+
+private:
+    FixedPool<sizeof(T), alignof(T)> pool_;
+};
+
+#endif // FIXED_POOL_HPP
@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "fixed_pool.hpp"
+
+// Test framework macros
+#define TEST_ASSERT(condition, message) \
+    do { \
+        if (!(condition)) { \
+            printf("FAIL: %s - %s\n", __func__, message); \
+            return 0; \
+        } \
+    } while(0)
+
+#define TEST_PASS() \
+    do { \
+        printf("PASS: %s\n", __func__); \
+        return 1; \
+    } while(0)
+
+#define RUN_TEST(test_func) \
+    do { \
+        printf("Running %s... ", #test_func); \
+        if (test_func()) { \
+            tests_passed++; \
+        } \
+        tests_total++; \
+    } while(0)
+
+int tests_passed = 0;
+int tests_total = 0;
+
+struct Point {
+    double x, y, z;
+    Point(double a, double b, double c) : x(a), y(b), z(c) {}
+};
+
+struct alignas(64) Padded {
+    char bytes[40];
+};
+
+// Geometry is fixed at compile time
+static_assert(FixedPool<24, 8>::stride == 24, "24-byte objects need no padding");
+static_assert(FixedPool<1, 1>::stride == sizeof(void*), "Objects hold at least a link");
+static_assert(FixedPool<40, 64>::stride == 64, "Stride is rounded to the alignment");
+static_assert(FixedPool<40, 64>::first_offset % 64 == 0, "First object is aligned");
+static_assert(ObjectPool<Point>::objects_per_slab ==
+              (SLAB_PAGE_SIZE - FixedPool<sizeof(Point), alignof(Point)>::first_offset) / sizeof(Point),
+              "Typed pool picks the matching size class");
+static_assert(FixedPool<512>::colors == 8, "Leftover lines become colors");
+static_assert(FixedPool<24, 8>::colors == 1, "No whole line left, no coloring");
+
+// Test 1: Objects are distinct, aligned and served from slab pages
+int test_pool_allocation() {
+    FixedPool<40, 64> pool;
+    void* ptrs[100];
+
+    for (int i = 0; i < 100; i++) {
+        ptrs[i] = pool.allocate();
+        TEST_ASSERT(ptrs[i] != nullptr, "Pool allocation failed");
+        TEST_ASSERT(((uintptr_t)ptrs[i] % 64) == 0, "Object not aligned");
+        TEST_ASSERT(is_slab_page_address(ptrs[i]), "Object not on a slab page");
+        memset(ptrs[i], i, 40);
+    }
+    for (int i = 1; i < 100; i++) {
+        TEST_ASSERT(ptrs[i] != ptrs[i - 1], "Pointers should be different");
+    }
+    for (int i = 0; i < 100; i++) {
+        pool.deallocate(ptrs[i]);
+    }
+
+    TEST_PASS();
+}
+
+// Test 2: Freed objects are reused LIFO
+int test_pool_reuse() {
+    FixedPool<32> pool;
+    void* a = pool.allocate();
+    pool.deallocate(a);
+    void* b = pool.allocate();
+    TEST_ASSERT(a == b, "Freed object not reused");
+    pool.deallocate(b);
+
+    TEST_PASS();
+}
+
+// Test 3: Filling more than one slab pulls a new page
+int test_pool_multiple_slabs() {
+    FixedPool<512> pool;
+    const std::size_t count = FixedPool<512>::objects_per_slab * 3;
+    void* first = pool.allocate();
+    TEST_ASSERT(first != nullptr, "Pool allocation failed");
+
+    for (std::size_t i = 1; i < count; i++) {
+        void* ptr = pool.allocate();
+        TEST_ASSERT(ptr != nullptr, "Pool allocation failed");
+        TEST_ASSERT(is_slab_page_address(ptr), "Object not on a slab page");
+    }
+
+    TEST_PASS();
+}
+
+// Test 4: Typed pool constructs and destroys objects
+int test_object_pool() {
+    ObjectPool<Point> points;
+    ObjectPool<Padded> padded;
+
+    Point* p = points.create(1.0, 2.0, 3.0);
+    TEST_ASSERT(p != nullptr, "Typed allocation failed");
+    TEST_ASSERT(p->x == 1.0 && p->y == 2.0 && p->z == 3.0, "Constructor not run");
+
+    Padded* q = padded.create();
+    TEST_ASSERT(((uintptr_t)q % 64) == 0, "Over-aligned type not aligned");
+
+    points.destroy(p);
+    padded.destroy(q);
+
+    TEST_PASS();
+}
+
+// Test 5: Consecutive slabs start their objects on different lines
+int test_pool_coloring() {
+    typedef FixedPool<512> Pool;
+    Pool pool;
+    uintptr_t first_page = 0;
+    std::size_t offsets[3];
+    std::size_t slabs = 0;
+
+    // The first object handed out from a fresh slab is its first object
+    for (std::size_t i = 0; i < Pool::objects_per_slab * 3; i++) {
+        uintptr_t ptr = (uintptr_t)pool.allocate();
+        uintptr_t page = ptr & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+        if (page != first_page) {
+            first_page = page;
+            offsets[slabs++] = ptr - page;
+        }
+    }
+    TEST_ASSERT(slabs == 3, "Objects not spread over three slabs");
+    for (std::size_t i = 0; i < 3; i++) {
+        TEST_ASSERT(offsets[i] == Pool::first_offset + i * Pool::color_step, "Slab not colored");
+    }
+
+    TEST_PASS();
+}
+
+int main() {
+    printf("=== Fixed Pool Test Suite ===\n\n");
+
+    RUN_TEST(test_pool_allocation);
+    RUN_TEST(test_pool_reuse);
+    RUN_TEST(test_pool_multiple_slabs);
+    RUN_TEST(test_object_pool);
+    RUN_TEST(test_pool_coloring);
+
+    printf("\n=== Test Results ===\n");
+    printf("Passed: %d/%d tests\n", tests_passed, tests_total);
+
+    return (tests_passed == tests_total) ? 0 : 1;
+}
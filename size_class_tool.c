@@ -0,0 +1,7 @@
+// Prints the compile-time size-class table and the waste of each class
+#include "allocator.h"
+
+int main() {
+    print_size_classes();
+    return 0;
+}